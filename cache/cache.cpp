@@ -0,0 +1,116 @@
+#include "cache.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+
+static const uint32_t CACHE_MAGIC = 0x43444c57;
+static const uint32_t CACHE_FORMAT = 1;
+
+struct cache_header_t
+{
+	uint32_t magic;
+	uint32_t format;
+	uint64_t key;
+	uint64_t size;
+	uint64_t checksum;
+};
+
+void hasher_t::add(const void *data, const size_t &size)
+{
+	const unsigned char *p = (const unsigned char *)data;
+	for (size_t i = 0; i < size; i++) {
+		value ^= p[i];
+		value *= 1099511628211ull;
+	}
+}
+
+void hasher_t::add(const std::string &s)
+{
+	add<uint64_t>(s.size());
+	add(s.data(), s.size());
+}
+
+static uint64_t checksum(const std::vector<char> &bytes)
+{
+	hasher_t h;
+	h.add(bytes.data(), bytes.size());
+	return h.value;
+}
+
+disk_cache_t::disk_cache_t(const std::string &directory)
+	: directory(directory)
+{
+}
+
+bool disk_cache_t::enabled() const
+{
+	return !directory.empty();
+}
+
+std::string disk_cache_t::path(const uint64_t &key) const
+{
+	char name[32];
+	std::snprintf(name, sizeof(name), "%016llx.stage", (unsigned long long)key);
+	return directory + "/" + name;
+}
+
+bool disk_cache_t::load(const uint64_t &key, blob_t &blob)
+{
+	blob.bytes.clear();
+	blob.cursor = 0;
+	std::ifstream file(path(key), std::ios::binary);
+	cache_header_t header;
+	if (!file.read((char *)&header, sizeof(header)) || header.magic != CACHE_MAGIC || header.format != CACHE_FORMAT || header.key != key) {
+		stats.misses++;
+		return false;
+	}
+	// a header claiming more than the file holds is damaged, not a reason to allocate it
+	std::error_code error;
+	uintmax_t length = std::filesystem::file_size(path(key), error);
+	if (error || length < sizeof(header) || header.size != length - sizeof(header)) {
+		stats.misses++;
+		return false;
+	}
+	blob.bytes.resize(header.size);
+	if (!file.read(blob.bytes.data(), header.size) || checksum(blob.bytes) != header.checksum) {
+		blob.bytes.clear();
+		stats.misses++;
+		return false;
+	}
+	stats.hits++;
+	stats.bytes_read += sizeof(header) + header.size;
+	return true;
+}
+
+void disk_cache_t::reject()
+{
+	stats.hits--;
+	stats.misses++;
+}
+
+void disk_cache_t::store(const uint64_t &key, const blob_t &blob)
+{
+	// a cache that cannot be written only costs the next run its hits
+	std::error_code error;
+	std::filesystem::create_directories(directory, error);
+	std::string target = path(key);
+	std::string temporary = target + ".tmp";
+	{
+		std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+		cache_header_t header{ CACHE_MAGIC, CACHE_FORMAT, key, blob.bytes.size(), checksum(blob.bytes) };
+		file.write((const char *)&header, sizeof(header));
+		file.write(blob.bytes.data(), blob.bytes.size());
+		if (!file) {
+			file.close();
+			std::filesystem::remove(temporary, error);
+			return;
+		}
+	}
+	std::filesystem::rename(temporary, target, error);
+	if (error) {
+		std::filesystem::remove(temporary, error);
+		return;
+	}
+	stats.bytes_written += sizeof(cache_header_t) + blob.bytes.size();
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/*
+ * 64-bit FNV-1a, fed piece by piece. Used to name cache entries by what went
+ * into them, so it only has to be stable, not strong.
+ */
+struct hasher_t
+{
+	uint64_t value = 14695981039346656037ull;
+
+	void add(const void *, const size_t &);
+	void add(const std::string &);
+
+	template<typename T>
+	void add(const T &v)
+	{
+		add(&v, sizeof(T));
+	}
+};
+
+/*
+ * A flat byte buffer written and read back in the same order. Values are
+ * copied as raw bytes, so a blob is only meant to be read on the machine
+ * that wrote it.
+ */
+struct blob_t
+{
+	std::vector<char> bytes;
+	size_t cursor = 0;
+
+	template<typename T>
+	void put(const T &v)
+	{
+		const char *p = (const char *)&v;
+		bytes.insert(bytes.end(), p, p + sizeof(T));
+	}
+
+	template<typename T, typename A>
+	void put(const std::vector<T, A> &v)
+	{
+		put<uint64_t>(v.size());
+		const char *p = (const char *)v.data();
+		bytes.insert(bytes.end(), p, p + v.size() * sizeof(T));
+	}
+
+	template<typename T>
+	bool get(T &v)
+	{
+		if (cursor + sizeof(T) > bytes.size())
+			return false;
+		std::memcpy(&v, bytes.data() + cursor, sizeof(T));
+		cursor += sizeof(T);
+		return true;
+	}
+
+	template<typename T, typename A>
+	bool get(std::vector<T, A> &v)
+	{
+		uint64_t size;
+		if (!get(size) || size > (bytes.size() - cursor) / sizeof(T))
+			return false;
+		v.resize(size);
+		std::memcpy(v.data(), bytes.data() + cursor, size * sizeof(T));
+		cursor += size * sizeof(T);
+		return true;
+	}
+};
+
+struct cache_stats_t
+{
+	size_t hits = 0;
+	size_t misses = 0;
+	size_t bytes_read = 0;
+	size_t bytes_written = 0;
+};
+
+/*
+ * Content-addressed files in one directory, one per key. Every file carries
+ * its key and a checksum of its contents; a file that is missing, truncated
+ * or does not match counts as a miss. Writes go to a temporary file that is
+ * renamed into place, so a reader never sees half an entry. A caller that
+ * finds a loaded entry unusable calls reject() to count it as a miss. An
+ * empty directory disables the cache.
+ */
+struct disk_cache_t
+{
+	std::string directory;
+	cache_stats_t stats;
+
+	disk_cache_t(const std::string & = "");
+	bool enabled() const;
+	bool load(const uint64_t &, blob_t &);
+	void reject();
+	void store(const uint64_t &, const blob_t &);
+
+private:
+	std::string path(const uint64_t &) const;
+};
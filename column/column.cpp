@@ -0,0 +1,341 @@
+#include "column.h"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <map>
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// every mapped array by its address, so one can be freed after its scope is gone
+struct mapped_array_t
+{
+	const column_store_t *store;
+	size_t bytes;
+};
+
+static std::mutex arrays_lock;
+static std::map<void *, mapped_array_t> arrays;
+static thread_local column_store_t *scope = NULL;
+
+#ifndef _WIN32
+// an unlinked file of the given size in the directory, or -1
+static int make_file(const std::string &directory, const size_t &bytes)
+{
+	std::error_code error;
+	std::filesystem::create_directories(directory, error);
+	std::string path = (std::filesystem::path(directory) / "column-XXXXXX").string();
+	std::vector<char> name(path.begin(), path.end());
+	name.push_back(0);
+	int file = mkstemp(name.data());
+	if (file < 0)
+		return -1;
+	unlink(name.data());
+	if (ftruncate(file, bytes) != 0) {
+		close(file);
+		return -1;
+	}
+	return file;
+}
+
+// workers are forked off a stage while other threads may be holding the registry
+static const int fork_guard = pthread_atfork([] { arrays_lock.lock(); }, [] { arrays_lock.unlock(); }, [] { arrays_lock.unlock(); });
+#endif
+
+column_store_t::~column_store_t()
+{
+	evict(0);
+}
+
+bool column_store_t::enabled() const
+{
+#ifndef _WIN32
+	return !directory.empty();
+#else
+	return false;
+#endif
+}
+
+column_stats_t column_store_t::get_stats() const
+{
+	column_stats_t result;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		result = stats;
+	}
+	std::lock_guard<std::mutex> guard(arrays_lock);
+	for (auto &a : arrays) {
+		if (a.second.store != this)
+			continue;
+		result.arrays++;
+		result.array_bytes += a.second.bytes;
+	}
+	return result;
+}
+
+// called with the lock held
+void column_store_t::evict(const size_t &limit)
+{
+#ifndef _WIN32
+	while (stats.mapped_bytes > limit && !idle.empty()) {
+		tile_t &t = idle.back();
+		munmap(t.data, t.bytes);
+		stats.mapped_bytes -= t.bytes;
+		idle.pop_back();
+	}
+#endif
+}
+
+char *column_store_t::acquire(const int &fd, const size_t &offset, const size_t &bytes)
+{
+#ifndef _WIN32
+	std::lock_guard<std::mutex> guard(lock);
+	for (auto it = idle.begin(); it != idle.end(); it++) {
+		if (it->fd == fd && it->offset == offset) {
+			char *data = it->data;
+			idle.erase(it);
+			return data;
+		}
+	}
+	// make room first, and once more with everything idle gone if the system is out of mappings
+	evict(budget > bytes ? budget - bytes : 0);
+	void *data = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
+	if (data == MAP_FAILED) {
+		evict(0);
+		data = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
+	}
+	if (data == MAP_FAILED) {
+		// still no mapping to be had, so the tile is read into memory and written back on release
+		char *copy = new char[bytes]();
+		if (pread(fd, copy, bytes, offset) < 0)
+			std::perror("column tile");
+		copies.push_back({ fd, offset, bytes, copy });
+		return copy;
+	}
+	stats.maps++;
+	stats.mapped_bytes += bytes;
+	if (stats.mapped_bytes > stats.peak_bytes)
+		stats.peak_bytes = stats.mapped_bytes;
+	return (char *)data;
+#else
+	return NULL;
+#endif
+}
+
+void column_store_t::release(const int &fd, const size_t &offset, const size_t &bytes, char *data)
+{
+	std::lock_guard<std::mutex> guard(lock);
+#ifndef _WIN32
+	for (auto it = copies.begin(); it != copies.end(); it++) {
+		if (it->data != data)
+			continue;
+		if (pwrite(fd, data, bytes, offset) != (ssize_t)bytes)
+			std::perror("column tile");
+		delete[] data;
+		copies.erase(it);
+		return;
+	}
+#endif
+	idle.push_front({ fd, offset, bytes, data });
+	evict(budget);
+}
+
+void column_store_t::forget(const int &fd)
+{
+#ifndef _WIN32
+	std::lock_guard<std::mutex> guard(lock);
+	for (auto it = idle.begin(); it != idle.end();) {
+		if (it->fd != fd) {
+			it++;
+			continue;
+		}
+		munmap(it->data, it->bytes);
+		stats.mapped_bytes -= it->bytes;
+		it = idle.erase(it);
+	}
+#endif
+}
+
+void *column_store_t::map_array(const size_t &bytes)
+{
+#ifndef _WIN32
+	if (!enabled())
+		return NULL;
+	int file = make_file(directory, bytes);
+	if (file < 0)
+		return NULL;
+	// the mapping keeps the file alive
+	void *data = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+	close(file);
+	if (data == MAP_FAILED)
+		return NULL;
+	std::lock_guard<std::mutex> guard(arrays_lock);
+	arrays[data] = { this, bytes };
+	return data;
+#else
+	return NULL;
+#endif
+}
+
+void column_store_t::trim()
+{
+#ifndef _WIN32
+	std::lock_guard<std::mutex> guard(arrays_lock);
+	size_t total = 0;
+	for (auto &a : arrays) {
+		if (a.second.store == this)
+			total += a.second.bytes;
+	}
+	if (total <= budget)
+		return;
+	// shared file pages only leave this process; whatever is touched again is read back
+	for (auto &a : arrays) {
+		if (a.second.store != this)
+			continue;
+		msync(a.first, a.second.bytes, MS_ASYNC);
+		madvise(a.first, a.second.bytes, MADV_DONTNEED);
+	}
+#endif
+}
+
+column_scope_t::column_scope_t(column_store_t *store)
+	: outer(scope)
+{
+	scope = store;
+}
+
+column_scope_t::~column_scope_t()
+{
+	scope = outer;
+}
+
+void *column_allocate(const size_t &bytes)
+{
+	if (scope != NULL && bytes >= COLUMN_TILE_SIZE) {
+		void *data = scope->map_array(bytes);
+		if (data != NULL)
+			return data;
+	}
+	return ::operator new(bytes);
+}
+
+void column_free(void *p, const size_t &bytes)
+{
+#ifndef _WIN32
+	if (bytes >= COLUMN_TILE_SIZE) {
+		std::lock_guard<std::mutex> guard(arrays_lock);
+		auto it = arrays.find(p);
+		if (it != arrays.end()) {
+			arrays.erase(it);
+			munmap(p, bytes);
+			return;
+		}
+	}
+#endif
+	::operator delete(p);
+}
+
+column_t::column_t(column_t &&c) noexcept
+{
+	*this = std::move(c);
+}
+
+column_t &column_t::operator=(column_t &&c) noexcept
+{
+	if (this == &c)
+		return *this;
+	clear();
+	store = c.store;
+	fd = c.fd;
+	count = c.count;
+	element = c.element;
+	memory = std::move(c.memory);
+	c.store = NULL;
+	c.fd = -1;
+	c.count = 0;
+	return *this;
+}
+
+column_t::~column_t()
+{
+	clear();
+}
+
+void column_t::clear()
+{
+#ifndef _WIN32
+	if (fd >= 0) {
+		store->forget(fd);
+		close(fd);
+	}
+#endif
+	store = NULL;
+	fd = -1;
+	count = 0;
+	memory.clear();
+	memory.shrink_to_fit();
+}
+
+void column_t::reset(column_store_t *store, const size_t &count, const size_t &element)
+{
+	clear();
+	this->count = count;
+	this->element = element;
+	if (count == 0)
+		return;
+#ifndef _WIN32
+	if (store != NULL && store->enabled()) {
+		int file = make_file(store->directory, count * element);
+		if (file >= 0) {
+			this->store = store;
+			fd = file;
+			return;
+		}
+	}
+#endif
+	// no room on disk is no reason to fail, the values just stay in memory
+	memory.assign(count * element, 0);
+}
+
+size_t column_t::size() const
+{
+	return count;
+}
+
+char *column_t::map(const size_t &first, const size_t &n) const
+{
+	if (fd < 0)
+		return (char *)memory.data() + first * element;
+	return store->acquire(fd, first * element, n * element);
+}
+
+void column_t::unmap(const size_t &first, const size_t &n, char *data) const
+{
+	if (fd >= 0)
+		store->release(fd, first * element, n * element, data);
+}
+
+void column_t::put(blob_t &blob) const
+{
+	blob.put<uint64_t>(count);
+	tiles<char>([&](const size_t &, const size_t &n, char *data) {
+		blob.bytes.insert(blob.bytes.end(), data, data + n * element);
+	});
+}
+
+bool column_t::get(blob_t &blob, column_store_t *store, const size_t &element)
+{
+	uint64_t size;
+	if (!blob.get(size) || size > (blob.bytes.size() - blob.cursor) / element)
+		return false;
+	reset(store, size, element);
+	tiles<char>([&](const size_t &, const size_t &n, char *data) {
+		std::memcpy(data, blob.bytes.data() + blob.cursor, n * element);
+		blob.cursor += n * element;
+	});
+	return true;
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "../cache/cache.h"
+
+/* values per tile, a multiple of the page size for every element size */
+static const size_t COLUMN_TILE_SIZE = 1 << 16;
+
+struct column_stats_t
+{
+	size_t maps = 0;
+	size_t mapped_bytes = 0;
+	size_t peak_bytes = 0;
+	size_t arrays = 0;
+	size_t array_bytes = 0;
+};
+
+/*
+ * Where tiled columns and column arrays keep their values. With a directory
+ * every column is a file in it, removed as soon as it is opened, and a tile
+ * is mapped in while it is used. Tiles nobody is using stay mapped, most
+ * recently used first, until the mapped total would pass the budget. A tile
+ * that cannot be mapped is read into memory and written back when released.
+ * Arrays are mapped whole; the system pages them out under pressure, and
+ * trim() drops every resident page of them once they total more than the
+ * budget. Without a directory, or on systems without mmap, columns and arrays
+ * are plain memory and the budget is ignored.
+ */
+struct column_store_t
+{
+	std::string directory;
+	size_t budget = 0;
+
+	~column_store_t();
+	bool enabled() const;
+	column_stats_t get_stats() const;
+
+	char *acquire(const int &, const size_t &, const size_t &);
+	void release(const int &, const size_t &, const size_t &, char *);
+	void forget(const int &);
+	void *map_array(const size_t &);
+	void trim();
+
+private:
+	struct tile_t
+	{
+		int fd;
+		size_t offset;
+		size_t bytes;
+		char *data;
+	};
+
+	mutable std::mutex lock;
+	std::list<tile_t> idle;
+	std::list<tile_t> copies;
+	column_stats_t stats;
+
+	void evict(const size_t &);
+};
+
+/*
+ * While a scope lives, column arrays of COLUMN_TILE_SIZE bytes or more
+ * allocated on its thread come from its store; scopes nest. Arrays can be
+ * freed on any thread, in a scope or not.
+ */
+struct column_scope_t
+{
+	explicit column_scope_t(column_store_t *);
+	column_scope_t(const column_scope_t &) = delete;
+	column_scope_t &operator=(const column_scope_t &) = delete;
+	~column_scope_t();
+
+private:
+	column_store_t *outer;
+};
+
+void *column_allocate(const size_t &);
+void column_free(void *, const size_t &);
+
+/* a vector of per-face values that leaves the heap for the store of the current column_scope_t */
+template<typename T>
+struct column_allocator_t
+{
+	typedef T value_type;
+
+	column_allocator_t() = default;
+	template<typename U>
+	column_allocator_t(const column_allocator_t<U> &) {}
+
+	T *allocate(size_t n) { return (T *)column_allocate(n * sizeof(T)); }
+	void deallocate(T *p, size_t n) { column_free(p, n * sizeof(T)); }
+};
+
+template<typename T, typename U>
+bool operator==(const column_allocator_t<T> &, const column_allocator_t<U> &) { return true; }
+template<typename T, typename U>
+bool operator!=(const column_allocator_t<T> &, const column_allocator_t<U> &) { return false; }
+
+template<typename T>
+using column_vector_t = std::vector<T, column_allocator_t<T>>;
+
+/*
+ * One value per face, of a fixed size, visited a tile at a time in face
+ * order: tiles() calls fn(first, count, data) with data pointing at the
+ * count values from face first on, which fn may read and write. put() and
+ * get() use the same layout as blob_t's vectors.
+ */
+struct column_t
+{
+	column_t() = default;
+	column_t(const column_t &) = delete;
+	column_t(column_t &&) noexcept;
+	column_t &operator=(column_t &&) noexcept;
+	~column_t();
+
+	void reset(column_store_t *, const size_t &, const size_t &);
+	size_t size() const;
+	void put(blob_t &) const;
+	bool get(blob_t &, column_store_t *, const size_t &);
+
+	template<typename T, typename F>
+	void tiles(F fn) const
+	{
+		for (size_t first = 0; first < count; first += COLUMN_TILE_SIZE) {
+			size_t n = count - first < COLUMN_TILE_SIZE ? count - first : COLUMN_TILE_SIZE;
+			char *data = map(first, n);
+			fn(first, n, (T *)data);
+			unmap(first, n, data);
+		}
+	}
+
+private:
+	column_store_t *store = NULL;
+	int fd = -1;
+	size_t count = 0;
+	size_t element = 0;
+	std::vector<char> memory;
+
+	char *map(const size_t &, const size_t &) const;
+	void unmap(const size_t &, const size_t &, char *) const;
+	void clear();
+};
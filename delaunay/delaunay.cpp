@@ -0,0 +1,235 @@
+#include "delaunay.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+
+#include "../parallel/parallel.h"
+
+namespace
+{
+	/* points bucketed by colatitude band, each band sorted by longitude */
+	struct band_index_t
+	{
+		const std::vector<glm::dvec3> &points;
+		double height;
+		std::vector<double> colatitude;
+		std::vector<std::vector<std::pair<double, uint32_t>>> bands;
+
+		band_index_t(const std::vector<glm::dvec3> &points, const double &spacing)
+			: points(points)
+		{
+			height = std::min(M_PI, std::max(spacing * 2, 1e-6));
+			bands.resize((size_t)std::ceil(M_PI / height) + 1);
+			colatitude.resize(points.size());
+			for (uint32_t i = 0; i < points.size(); i++) {
+				const glm::dvec3 &p = points[i];
+				double r = std::sqrt(glm::dot(p, p));
+				colatitude[i] = std::acos(std::max(-1.0, std::min(1.0, p.z / r)));
+				bands[(size_t)(colatitude[i] / height)].push_back({ std::atan2(p.y, p.x), i });
+			}
+			parallel_for(bands.size(), [&](const size_t &from, const size_t &to) {
+				for (size_t b = from; b < to; b++)
+					std::sort(bands[b].begin(), bands[b].end());
+			});
+		}
+
+		// every point but p within the angle reach of p
+		void within(const uint32_t &p, const double &reach, std::vector<uint32_t> &found) const
+		{
+			found.clear();
+			const glm::dvec3 &c = points[p];
+			const double r = std::sqrt(glm::dot(c, c));
+			const double theta = colatitude[p], phi = std::atan2(c.y, c.x);
+			const double least = std::cos(reach);
+			// the widest longitude a cap of this reach spans, unless it holds a pole
+			bool all = theta - reach <= 0 || theta + reach >= M_PI || std::sin(theta) <= std::sin(reach);
+			double span = all ? M_PI : std::asin(std::sin(reach) / std::sin(theta));
+			if (span >= M_PI)
+				all = true;
+
+			size_t first = (size_t)std::max(0.0, (theta - reach) / height);
+			size_t last = std::min(bands.size() - 1, (size_t)std::max(0.0, (theta + reach) / height));
+			auto take = [&](const std::pair<double, uint32_t> &e) {
+				if (e.second == p)
+					return;
+				const glm::dvec3 &q = points[e.second];
+				if (glm::dot(c, q) >= least * r * std::sqrt(glm::dot(q, q)))
+					found.push_back(e.second);
+			};
+			auto range = [&](const std::vector<std::pair<double, uint32_t>> &band, const double &from, const double &to) {
+				auto it = std::lower_bound(band.begin(), band.end(), std::make_pair(from, (uint32_t)0));
+				for (; it != band.end() && it->first <= to; it++)
+					take(*it);
+			};
+			for (size_t b = first; b <= last; b++) {
+				const auto &band = bands[b];
+				if (all) {
+					for (auto &e : band)
+						take(e);
+					continue;
+				}
+				double from = phi - span, to = phi + span;
+				range(band, std::max(from, -M_PI), std::min(to, M_PI));
+				if (from < -M_PI)
+					range(band, from + 2 * M_PI, M_PI);
+				if (to > M_PI)
+					range(band, -M_PI, to - 2 * M_PI);
+			}
+		}
+	};
+
+	/*
+	 * Whether d is above the plane through a, b and c, wound counterclockwise
+	 * seen from above. Close calls are settled by the determinant of the four
+	 * points taken in index order, which is the same from every star.
+	 */
+	struct orient_t
+	{
+		const std::vector<glm::dvec3> &points;
+
+		double exact(uint32_t v[4]) const
+		{
+			bool odd = false;
+			for (int i = 0; i < 4; i++) {
+				for (int j = 0; j < 3 - i; j++) {
+					if (v[j] > v[j + 1]) {
+						std::swap(v[j], v[j + 1]);
+						odd = !odd;
+					}
+				}
+			}
+			const glm::dvec3 &o = points[v[0]];
+			double det = glm::dot(glm::cross(points[v[1]] - o, points[v[2]] - o), points[v[3]] - o);
+			return odd ? -det : det;
+		}
+
+		// normal is (b - a) x (c - a), scale the product of those two lengths, and to is d - a
+		bool above(const uint32_t &a, const uint32_t &b, const uint32_t &c, const uint32_t &d,
+			const glm::dvec3 &normal, const double &scale, const glm::dvec3 &to, const double &length) const
+		{
+			double det = glm::dot(normal, to);
+			double bound = 64 * DBL_EPSILON * scale * length;
+			if (std::fabs(det) > bound)
+				return det > 0;
+			uint32_t v[4] = { a, b, c, d };
+			return exact(v) > 0;
+		}
+	};
+}
+
+bool triangulate_sphere(const std::vector<glm::dvec3> &points, const double &spacing, column_vector_t<uint32_t> &faces)
+{
+	faces.clear();
+	const size_t n = points.size();
+	if (n < 4)
+		return false;
+
+	band_index_t index(points, spacing);
+	orient_t orient{ points };
+	double radius = 0;
+	for (auto &p : points)
+		radius = std::max(radius, std::sqrt(glm::dot(p, p)));
+
+	// a point around p, as seen from p
+	struct spoke_t
+	{
+		uint32_t id;
+		glm::dvec3 to;
+		double length;
+	};
+
+	// a star is the ring of points around p, each face (p, ring[k], ring[k + 1]) with nothing above it
+	auto star = [&](const uint32_t &p, const double &reach, const std::vector<uint32_t> &nearby, std::vector<spoke_t> &spokes, std::vector<uint32_t> &ring) {
+		ring.clear();
+		if (nearby.size() < 3)
+			return false;
+		const glm::dvec3 &o = points[p];
+		spokes.clear();
+		size_t first = 0;
+		for (auto &q : nearby) {
+			glm::dvec3 to = points[q] - o;
+			spokes.push_back({ q, to, std::sqrt(glm::dot(to, to)) });
+			const spoke_t &f = spokes[first], &s = spokes.back();
+			if (s.length < f.length || (s.length == f.length && s.id < f.id))
+				first = spokes.size() - 1;
+		}
+		size_t current = first;
+		do {
+			// wrap around the edge (p, current) to the face with nothing above it
+			const spoke_t &edge = spokes[current];
+			size_t next = current == 0 ? 1 : 0;
+			glm::dvec3 normal = glm::cross(edge.to, spokes[next].to);
+			double scale = edge.length * spokes[next].length;
+			auto above = [&](const size_t &k) {
+				const spoke_t &s = spokes[k];
+				return k != current && k != next && orient.above(p, edge.id, spokes[next].id, s.id, normal, scale, s.to, s.length);
+			};
+			for (size_t k = 0; k < spokes.size(); k++) {
+				if (above(k)) {
+					next = k;
+					normal = glm::cross(edge.to, spokes[next].to);
+					scale = edge.length * spokes[next].length;
+				}
+			}
+			// accepted only if no point of the neighborhood is above it and its cap fits inside the neighborhood
+			double length = std::sqrt(glm::dot(normal, normal));
+			if (length == 0)
+				return false;
+			for (size_t k = 0; k < spokes.size(); k++) {
+				if (above(k))
+					return false;
+			}
+			double cap = std::acos(std::max(-1.0, std::min(1.0, glm::dot(normal, o) / length / radius)));
+			if (glm::dot(normal, o) <= 0 || 2 * cap >= reach)
+				return false;
+			ring.push_back(edge.id);
+			current = next;
+			if (ring.size() > spokes.size())
+				return false;
+		} while (current != first);
+		return ring.size() >= 3;
+	};
+
+	const size_t chunks = std::min(n, (size_t)256);
+	std::vector<std::vector<uint32_t>> found(chunks);
+	std::atomic<bool> failed{ false };
+	parallel_for(chunks, [&](const size_t &from, const size_t &to) {
+		std::vector<uint32_t> nearby, ring;
+		std::vector<spoke_t> spokes;
+		for (size_t c = from; c < to && !failed; c++) {
+			std::vector<uint32_t> &out = found[c];
+			out.reserve((n * (c + 1) / chunks - n * c / chunks) * 2 * 3);
+			for (uint32_t p = n * c / chunks; p < n * (c + 1) / chunks; p++) {
+				double reach = std::min(M_PI, spacing * 2.5);
+				while (true) {
+					index.within(p, reach, nearby);
+					if (star(p, reach, nearby, spokes, ring))
+						break;
+					if (reach >= M_PI) {
+						failed = true;
+						return;
+					}
+					reach = std::min(M_PI, reach * 2);
+				}
+				for (size_t k = 0; k < ring.size(); k++) {
+					uint32_t a = ring[k], b = ring[(k + 1) % ring.size()];
+					if (p < a && p < b)
+						out.insert(out.end(), { p, a, b });
+				}
+			}
+		}
+	});
+
+	// a closed triangulation of n points on a sphere has 2n - 4 faces
+	size_t total = 0;
+	for (auto &f : found)
+		total += f.size();
+	if (failed || total != (2 * n - 4) * 3)
+		return false;
+	faces.reserve(total);
+	for (auto &f : found)
+		faces.insert(faces.end(), f.begin(), f.end());
+	return true;
+}
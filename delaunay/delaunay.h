@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "../column/column.h"
+
+/*
+ * The convex hull of points on the unit sphere, give or take rounding, which
+ * is their spherical Delaunay triangulation. Every point finds its own star,
+ * the faces around it, from the points within a few spacings of it, so the
+ * points are split over parallel_for with no merge step: a face is kept by
+ * the star of its lowest point. A star is only accepted once none of its
+ * faces could have a point above it outside the neighborhood searched, which
+ * is widened until that holds. Tests between four points are evaluated in
+ * one fixed order, so the stars of neighboring points agree.
+ *
+ * Faces come out wound counterclockwise seen from outside, three point
+ * indices each, ordered by their lowest point whatever the thread count.
+ * spacing is the rough angle between neighboring points. Returns false and
+ * leaves the faces empty if the stars do not close into one sphere.
+ */
+bool triangulate_sphere(const std::vector<glm::dvec3> &, const double &, column_vector_t<uint32_t> &);
@@ -0,0 +1,624 @@
+#include "distribute.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <queue>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "../parallel/parallel.h"
+
+static const unsigned int NONE = UINT_MAX;
+
+partition_t::partition_t(const std::vector<surface_t *> &faces, const double &band_size, const int &workers)
+	: owner(faces.size(), 0)
+	, halo_of(faces.size())
+{
+	const int band_count = foehn_band_count(band_size);
+	parts = CLAMP<int>(workers, 1, band_count);
+	std::vector<int> band(faces.size());
+	std::vector<size_t> size(band_count, 0);
+	for (auto &f : faces) {
+		band[f->ID] = foehn_band(f, band_size);
+		size[band[f->ID]]++;
+	}
+
+	// whole bands from the south, cutting once a part has its share
+	std::vector<int> part_of(band_count, 0);
+	bands.assign(parts, {});
+	size_t seen = 0;
+	int part = 0;
+	for (int b = 0; b < band_count; b++) {
+		if (part + 1 < parts && !bands[part].empty()
+			&& (seen >= faces.size() * (part + 1) / parts || band_count - b <= parts - 1 - part))
+			part++;
+		part_of[b] = part;
+		bands[part].push_back(b);
+		seen += size[b];
+	}
+
+	owned.assign(parts, {});
+	for (auto &f : faces) {
+		owner[f->ID] = part_of[band[f->ID]];
+		owned[owner[f->ID]].push_back(f);
+	}
+	for (auto &f : faces) {
+		for (auto &n : f->neighbors) {
+			int p = owner[n->ID];
+			if (p != owner[f->ID] && std::find(halo_of[f->ID].begin(), halo_of[f->ID].end(), p) == halo_of[f->ID].end())
+				halo_of[f->ID].push_back(p);
+		}
+	}
+}
+
+// halo faces with a value and a tag each, what both sides of an exchange send
+struct halo_t
+{
+	std::vector<uint32_t> face;
+	std::vector<double> value;
+	std::vector<uint32_t> tag;
+
+	void add(const uint32_t &f, const double &v, const uint32_t &t)
+	{
+		face.push_back(f);
+		value.push_back(v);
+		tag.push_back(t);
+	}
+
+	void put(blob_t &blob) const
+	{
+		blob.put(face);
+		blob.put(value);
+		blob.put(tag);
+	}
+
+	bool get(blob_t &blob)
+	{
+		return blob.get(face) && blob.get(value) && blob.get(tag) && value.size() == face.size() && tag.size() == face.size();
+	}
+};
+
+#ifndef _WIN32
+static bool write_all(const int &fd, const char *p, size_t n)
+{
+	while (n > 0) {
+		ssize_t w = send(fd, p, n, MSG_NOSIGNAL);
+		if (w < 0 && errno == EINTR)
+			continue;
+		if (w <= 0)
+			return false;
+		p += w;
+		n -= w;
+	}
+	return true;
+}
+
+static bool read_all(const int &fd, char *p, size_t n)
+{
+	while (n > 0) {
+		ssize_t r = recv(fd, p, n, 0);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0)
+			return false;
+		p += r;
+		n -= r;
+	}
+	return true;
+}
+
+// a message is its length followed by a blob
+static size_t send_blob(const int &fd, const blob_t &blob)
+{
+	uint64_t size = blob.bytes.size();
+	if (!write_all(fd, (const char *)&size, sizeof(size)) || !write_all(fd, blob.bytes.data(), blob.bytes.size()))
+		return 0;
+	return sizeof(size) + blob.bytes.size();
+}
+
+static size_t receive_blob(const int &fd, blob_t &blob)
+{
+	uint64_t size;
+	if (!read_all(fd, (char *)&size, sizeof(size)))
+		return 0;
+	blob.bytes.resize(size);
+	blob.cursor = 0;
+	if (!read_all(fd, blob.bytes.data(), size))
+		return 0;
+	return sizeof(size) + size;
+}
+#endif
+
+// a worker's end of its socket; a worker that loses the coordinator just exits
+struct cluster_t::link_t
+{
+	int fd;
+
+	// sends this part's changed boundary faces, receives its changed halo in their place
+	bool exchange(halo_t &halo)
+	{
+#ifndef _WIN32
+		blob_t out;
+		halo.put(out);
+		blob_t in;
+		uint8_t more = 0;
+		if (send_blob(fd, out) == 0 || receive_blob(fd, in) == 0 || !in.get(more) || !halo.get(in))
+			_exit(1);
+		return more != 0;
+#else
+		return false;
+#endif
+	}
+
+	void finish(const blob_t &result)
+	{
+#ifndef _WIN32
+		send_blob(fd, result);
+		_exit(0);
+#endif
+	}
+};
+
+bool cluster_t::enabled() const
+{
+#ifndef _WIN32
+	return workers > 1;
+#else
+	return false;
+#endif
+}
+
+bool cluster_t::run(const std::string &stage, const partition_t &partition, const std::function<void(const int &, link_t &)> &work, const std::function<bool(const int &, blob_t &)> &collect)
+{
+#ifndef _WIN32
+	const int parts = partition.parts;
+	std::vector<int> fds;
+	std::vector<pid_t> pids;
+	bool ok = true;
+	for (int p = 0; p < parts && ok; p++) {
+		int pair[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0) {
+			ok = false;
+			break;
+		}
+		pid_t pid = fork();
+		if (pid == 0) {
+			// only this thread made it into the child, so its loops must not wait on the pool
+			set_thread_count(1);
+			close(pair[0]);
+			for (auto &fd : fds)
+				close(fd);
+			link_t link{ pair[1] };
+			work(p, link);
+			_exit(1);
+		}
+		close(pair[1]);
+		if (pid < 0) {
+			close(pair[0]);
+			ok = false;
+			break;
+		}
+		fds.push_back(pair[0]);
+		pids.push_back(pid);
+	}
+
+	exchange_stats_t used;
+	used.runs = 1;
+	bool more = ok;
+	while (more) {
+		std::vector<halo_t> inbound(parts);
+		size_t changed = 0;
+		for (int p = 0; p < parts && ok; p++) {
+			blob_t message;
+			halo_t halo;
+			size_t bytes = receive_blob(fds[p], message);
+			if (bytes == 0 || !halo.get(message)) {
+				ok = false;
+				break;
+			}
+			used.bytes += bytes;
+			changed += halo.face.size();
+			for (size_t i = 0; i < halo.face.size(); i++) {
+				if (halo.face[i] >= partition.halo_of.size()) {
+					ok = false;
+					break;
+				}
+				for (auto &q : partition.halo_of[halo.face[i]]) {
+					inbound[q].add(halo.face[i], halo.value[i], halo.tag[i]);
+					used.halo_faces++;
+				}
+			}
+		}
+		if (!ok)
+			break;
+		used.rounds++;
+		more = changed > 0;
+		for (int p = 0; p < parts && ok; p++) {
+			blob_t message;
+			message.put<uint8_t>(more);
+			inbound[p].put(message);
+			size_t bytes = send_blob(fds[p], message);
+			ok = bytes > 0;
+			used.bytes += bytes;
+		}
+		more = more && ok;
+	}
+	for (int p = 0; p < (int)fds.size() && ok; p++) {
+		blob_t result;
+		size_t bytes = receive_blob(fds[p], result);
+		ok = bytes > 0 && collect(p, result);
+		used.bytes += bytes;
+	}
+
+	// closing the sockets makes any worker still waiting give up
+	for (auto &fd : fds)
+		close(fd);
+	for (auto &pid : pids) {
+		int status = 0;
+		if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			ok = false;
+	}
+	if (!ok)
+		return false;
+
+	std::lock_guard<std::mutex> guard(lock);
+	auto it = std::find_if(stats.begin(), stats.end(), [&](const std::pair<std::string, exchange_stats_t> &s) {
+		return s.first == stage;
+	});
+	if (it == stats.end()) {
+		stats.push_back({ stage, exchange_stats_t() });
+		it = stats.end() - 1;
+	}
+	it->second.runs += used.runs;
+	it->second.rounds += used.rounds;
+	it->second.halo_faces += used.halo_faces;
+	it->second.bytes += used.bytes;
+	return true;
+#else
+	return false;
+#endif
+}
+
+struct part_entry_t
+{
+	double key;
+	unsigned int tag;
+	unsigned int face;
+
+	const bool operator>(const part_entry_t &e) const
+	{
+		if (key != e.key)
+			return key > e.key;
+		if (tag != e.tag)
+			return tag > e.tag;
+		return face > e.face;
+	}
+};
+
+typedef std::priority_queue<part_entry_t, std::vector<part_entry_t>, std::greater<part_entry_t>> part_queue_t;
+
+// boundary faces whose value changed since the last exchange
+struct outbox_t
+{
+	const partition_t &partition;
+	std::vector<bool> queued;
+	std::vector<unsigned int> faces;
+
+	outbox_t(const partition_t &partition)
+		: partition(partition)
+		, queued(partition.owner.size(), false)
+	{
+	}
+
+	void mark(const unsigned int &f)
+	{
+		if (!partition.halo_of[f].empty() && !queued[f]) {
+			queued[f] = true;
+			faces.push_back(f);
+		}
+	}
+
+	template<typename Value, typename Tag>
+	halo_t take(Value value, Tag tag)
+	{
+		halo_t halo;
+		for (auto &f : faces) {
+			halo.add(f, value(f), tag(f));
+			queued[f] = false;
+		}
+		faces.clear();
+		return halo;
+	}
+};
+
+distance_field_t cluster_t::distance_field(const std::vector<surface_t *> &faces, const surface_t::surface_type &type, const std::string &stage)
+{
+	if (!enabled())
+		return distance_field_t(faces, type);
+	partition_t partition(faces, band_size, workers);
+
+	// the same relaxation as distance_field_t, pushing only into faces of this part
+	auto work = [&](const int &part, link_t &link) {
+		std::vector<double> path(faces.size(), INFINITY);
+		std::vector<unsigned int> source(faces.size(), NONE);
+		part_queue_t open;
+		outbox_t outbox(partition);
+		for (auto &f : partition.owned[part]) {
+			if (f->type != type)
+				continue;
+			path[f->ID] = 0;
+			source[f->ID] = f->ID;
+			open.push({ 0, (unsigned int)f->ID, (unsigned int)f->ID });
+			outbox.mark(f->ID);
+		}
+		bool more = true;
+		while (more) {
+			while (!open.empty()) {
+				part_entry_t e = open.top();
+				open.pop();
+				if (e.key > path[e.face] || source[e.face] != e.tag)
+					continue;
+				surface_t *curr = faces[e.face];
+				for (auto &n : curr->neighbors) {
+					if (partition.owner[n->ID] != part)
+						continue;
+					double t = e.key + face_arc(curr, n);
+					if (t < path[n->ID] || (t == path[n->ID] && e.tag < source[n->ID])) {
+						path[n->ID] = t;
+						source[n->ID] = e.tag;
+						open.push({ t, e.tag, (unsigned int)n->ID });
+						outbox.mark(n->ID);
+					}
+				}
+			}
+			halo_t halo = outbox.take([&](const unsigned int &f) { return path[f]; }, [&](const unsigned int &f) { return source[f]; });
+			more = link.exchange(halo);
+			for (size_t i = 0; i < halo.face.size(); i++) {
+				path[halo.face[i]] = halo.value[i];
+				source[halo.face[i]] = halo.tag[i];
+				open.push({ halo.value[i], halo.tag[i], halo.face[i] });
+			}
+		}
+		blob_t result;
+		std::vector<double> own_path, own_distance;
+		std::vector<uint32_t> own_source;
+		for (auto &f : partition.owned[part]) {
+			own_path.push_back(path[f->ID]);
+			own_source.push_back(source[f->ID]);
+			if (source[f->ID] == NONE)
+				own_distance.push_back(INFINITY);
+			else
+				own_distance.push_back(source[f->ID] == f->ID ? 0 : face_arc(f, faces[source[f->ID]]));
+		}
+		result.put(own_path);
+		result.put(own_distance);
+		result.put(own_source);
+		link.finish(result);
+	};
+
+	distance_field_t field(type, faces.size());
+	auto collect = [&](const int &part, blob_t &result) {
+		std::vector<double> own_path, own_distance;
+		std::vector<uint32_t> own_source;
+		const std::vector<surface_t *> &owned = partition.owned[part];
+		if (!result.get(own_path) || !result.get(own_distance) || !result.get(own_source)
+			|| own_path.size() != owned.size() || own_distance.size() != owned.size() || own_source.size() != owned.size())
+			return false;
+		for (size_t i = 0; i < owned.size(); i++) {
+			if (own_source[i] != NONE && own_source[i] >= faces.size())
+				return false;
+			field.path[owned[i]->ID] = own_path[i];
+			field.distance[owned[i]->ID] = own_distance[i];
+			field.nearest[owned[i]->ID] = own_source[i] == NONE ? NULL : faces[own_source[i]];
+		}
+		return true;
+	};
+	if (!run(stage, partition, work, collect))
+		return distance_field_t(faces, type);
+	return field;
+}
+
+components_t cluster_t::components(const std::vector<surface_t *> &faces, const surface_t::surface_type &type, const std::string &stage)
+{
+	if (!enabled())
+		return components_t(faces, type);
+	partition_t partition(faces, band_size, workers);
+
+	// every face ends up labeled with the lowest face ID it is connected to
+	auto work = [&](const int &part, link_t &link) {
+		std::vector<unsigned int> label(faces.size(), NONE);
+		outbox_t outbox(partition);
+		std::vector<surface_t *> stack;
+		auto spread = [&](surface_t *from, const unsigned int &root) {
+			label[from->ID] = root;
+			outbox.mark(from->ID);
+			stack.push_back(from);
+			while (!stack.empty()) {
+				surface_t *curr = stack.back();
+				stack.pop_back();
+				for (auto &n : curr->neighbors) {
+					if (partition.owner[n->ID] != part || n->type != type || label[n->ID] <= root)
+						continue;
+					label[n->ID] = root;
+					outbox.mark(n->ID);
+					stack.push_back(n);
+				}
+			}
+		};
+		// owned faces are in ID order, so the first face reached of a local component is its lowest
+		for (auto &f : partition.owned[part]) {
+			if (f->type == type && label[f->ID] == NONE)
+				spread(f, f->ID);
+		}
+		bool more = true;
+		while (more) {
+			halo_t halo = outbox.take([](const unsigned int &) { return 0.0; }, [&](const unsigned int &f) { return label[f]; });
+			more = link.exchange(halo);
+			for (size_t i = 0; i < halo.face.size(); i++) {
+				label[halo.face[i]] = halo.tag[i];
+				for (auto &n : faces[halo.face[i]]->neighbors) {
+					if (partition.owner[n->ID] == part && n->type == type && label[n->ID] > halo.tag[i])
+						spread(n, halo.tag[i]);
+				}
+			}
+		}
+		blob_t result;
+		std::vector<uint32_t> own;
+		for (auto &f : partition.owned[part])
+			own.push_back(label[f->ID]);
+		result.put(own);
+		link.finish(result);
+	};
+
+	column_vector_t<unsigned int> roots(faces.size(), NONE);
+	auto collect = [&](const int &part, blob_t &result) {
+		std::vector<uint32_t> own;
+		const std::vector<surface_t *> &owned = partition.owned[part];
+		if (!result.get(own) || own.size() != owned.size())
+			return false;
+		for (size_t i = 0; i < owned.size(); i++) {
+			if (own[i] != NONE && own[i] >= faces.size())
+				return false;
+			roots[owned[i]->ID] = own[i];
+		}
+		return true;
+	};
+	if (!run(stage, partition, work, collect))
+		return components_t(faces, type);
+	return components_t(faces, roots);
+}
+
+hydrology_t cluster_t::flood(const std::vector<surface_t *> &faces, const std::string &stage)
+{
+	if (!enabled())
+		return hydrology_t(faces);
+	partition_t partition(faces, band_size, workers);
+
+	// the flood's (filled, steps) as a fixpoint: every face takes the best its neighbors offer
+	auto work = [&](const int &part, link_t &link) {
+		std::vector<double> filled(faces.size(), INFINITY);
+		std::vector<unsigned int> steps(faces.size(), 0);
+		part_queue_t open;
+		outbox_t outbox(partition);
+		for (auto &f : partition.owned[part]) {
+			if (f->type != surface_t::FACE_OCEAN)
+				continue;
+			filled[f->ID] = f->height;
+			open.push({ f->height, 0, (unsigned int)f->ID });
+			outbox.mark(f->ID);
+		}
+		bool more = true;
+		while (more) {
+			while (!open.empty()) {
+				part_entry_t e = open.top();
+				open.pop();
+				if (e.key != filled[e.face] || e.tag != steps[e.face])
+					continue;
+				for (auto &n : faces[e.face]->neighbors) {
+					if (partition.owner[n->ID] != part || n->type == surface_t::FACE_OCEAN)
+						continue;
+					double c = MAX<double>(n->height, e.key);
+					unsigned int s = c == e.key ? e.tag + 1 : 0;
+					if (c < filled[n->ID] || (c == filled[n->ID] && s < steps[n->ID])) {
+						filled[n->ID] = c;
+						steps[n->ID] = s;
+						open.push({ c, s, (unsigned int)n->ID });
+						outbox.mark(n->ID);
+					}
+				}
+			}
+			halo_t halo = outbox.take([&](const unsigned int &f) { return filled[f]; }, [&](const unsigned int &f) { return steps[f]; });
+			more = link.exchange(halo);
+			for (size_t i = 0; i < halo.face.size(); i++) {
+				filled[halo.face[i]] = halo.value[i];
+				steps[halo.face[i]] = halo.tag[i];
+				open.push({ halo.value[i], halo.tag[i], halo.face[i] });
+			}
+		}
+		blob_t result;
+		std::vector<double> own_filled;
+		std::vector<uint32_t> own_steps;
+		for (auto &f : partition.owned[part]) {
+			own_filled.push_back(filled[f->ID]);
+			own_steps.push_back(steps[f->ID]);
+		}
+		result.put(own_filled);
+		result.put(own_steps);
+		link.finish(result);
+	};
+
+	std::vector<double> filled(faces.size(), INFINITY);
+	std::vector<unsigned int> steps(faces.size(), 0);
+	auto collect = [&](const int &part, blob_t &result) {
+		std::vector<double> own_filled;
+		std::vector<uint32_t> own_steps;
+		const std::vector<surface_t *> &owned = partition.owned[part];
+		if (!result.get(own_filled) || !result.get(own_steps) || own_filled.size() != owned.size() || own_steps.size() != owned.size())
+			return false;
+		for (size_t i = 0; i < owned.size(); i++) {
+			filled[owned[i]->ID] = own_filled[i];
+			steps[owned[i]->ID] = own_steps[i];
+		}
+		return true;
+	};
+	if (!run(stage, partition, work, collect))
+		return hydrology_t(faces);
+	return hydrology_t(faces, filled, steps);
+}
+
+void cluster_t::advect(foehn_t &foehn, const std::vector<surface_t *> &faces, const std::string &stage)
+{
+	if (!enabled()) {
+		foehn.advect(faces);
+		return;
+	}
+	partition_t partition(faces, band_size, workers);
+
+	// a sweep leaves parts on faces in its band and the bands within reach of it, tagged with the band
+	auto work = [&](const int &part, link_t &link) {
+		foehn_t local;
+		local.build(faces, band_size);
+		local.sweep(partition.bands[part]);
+		halo_t none;
+		link.exchange(none);
+
+		halo_t swept;
+		for (auto &p : local.get_parts())
+			swept.add(p.face, p.value, p.band);
+		blob_t result;
+		swept.put(result);
+		link.finish(result);
+	};
+
+	std::vector<foehn_part_t> parts;
+	auto collect = [&](const int &, blob_t &result) {
+		halo_t swept;
+		if (!swept.get(result))
+			return false;
+		for (size_t i = 0; i < swept.face.size(); i++)
+			parts.push_back({ swept.tag[i], swept.face[i], swept.value[i] });
+		return true;
+	};
+	if (!run(stage, partition, work, collect) || !foehn.restore(parts)) {
+		foehn.advect(faces);
+		return;
+	}
+	foehn.collect(faces);
+}
+
+void cluster_t::clear_stats()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	stats.clear();
+}
+
+std::vector<std::pair<std::string, exchange_stats_t>> cluster_t::get_stats() const
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return stats;
+}
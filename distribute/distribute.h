@@ -0,0 +1,76 @@
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "../surface/surface.h"
+#include "../cache/cache.h"
+#include "../field/field.h"
+#include "../label/label.h"
+#include "../hydrology/hydrology.h"
+#include "../wind/wind.h"
+
+/* what the worker processes of one stage sent through their sockets */
+struct exchange_stats_t
+{
+	size_t runs = 0;
+	size_t rounds = 0;
+	size_t halo_faces = 0;
+	size_t bytes = 0;
+};
+
+/*
+ * The faces cut into latitude stripes of whole foehn bands, about the same
+ * number of faces to each part. A face is in the halo of every other part
+ * that owns one of its neighbors; halo_of lists those parts, so a face with
+ * an empty list is interior to its own part.
+ */
+struct partition_t
+{
+	int parts = 0;
+	std::vector<int> owner;
+	std::vector<std::vector<surface_t *>> owned;
+	std::vector<std::vector<int>> halo_of;
+	std::vector<std::vector<int>> bands;
+
+	partition_t(const std::vector<surface_t *> &, const double &, const int &);
+};
+
+/*
+ * Neighbor-dependent passes split over worker processes, one per part of a
+ * partition_t. Workers are forked for every pass, so they start from the
+ * caller's faces, and only ever read their own faces and their halo. Passes
+ * that spread along the neighbor graph (distance fields, the drainage flood,
+ * component labels) relax their own part to a fixpoint, then send the
+ * boundary faces that changed to the coordinator, which routes them to the
+ * parts that have them in their halo; this repeats until a round in which no
+ * part changed anything. Every pass settles on the same unique fixpoint the
+ * single-process code does, so the results match it bit for bit. Foehn
+ * sweeps need no rounds: every part sweeps its own bands and sends back the
+ * parts of the faces its sweeps reach.
+ *
+ * Traffic is counted per stage name. Without fork (Windows), with fewer than
+ * two workers, or when a worker fails, the pass runs in this process instead.
+ */
+struct cluster_t
+{
+	int workers = 0;
+	double band_size = 1;
+
+	bool enabled() const;
+	distance_field_t distance_field(const std::vector<surface_t *> &, const surface_t::surface_type &, const std::string &);
+	components_t components(const std::vector<surface_t *> &, const surface_t::surface_type &, const std::string &);
+	hydrology_t flood(const std::vector<surface_t *> &, const std::string &);
+	void advect(foehn_t &, const std::vector<surface_t *> &, const std::string &);
+	void clear_stats();
+	std::vector<std::pair<std::string, exchange_stats_t>> get_stats() const;
+
+	struct link_t;
+private:
+	mutable std::mutex lock;
+	std::vector<std::pair<std::string, exchange_stats_t>> stats;
+
+	bool run(const std::string &, const partition_t &, const std::function<void(const int &, link_t &)> &, const std::function<bool(const int &, blob_t &)> &);
+};
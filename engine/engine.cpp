@@ -10,6 +10,7 @@
 #include <bits/stdc++.h>
 
 #include "../FONT.h"
+#include "../parallel/parallel.h"
 
 void engine_t::draw_letter(const char &c, const double &size, const double &x, const double &y)
 {
@@ -106,22 +107,6 @@ const glm::mat3 rot_y(const double &theta)
 	return m;
 }
 
-surface_t *get_face_from_point(const polar_t &p, const std::vector<surface_t *> &set)
-{
-	surface_t *curr = NULL;
-	double dist = 100.0;
-	for (auto &s : set) {
-		point3_t cc(p, 1.0);
-		auto x = glm::dot(cc.coords, s->get_center_c().coords);
-		double d = std::acos(x);
-		if (curr == NULL || d < dist) {
-			curr = s;
-			dist = d;
-		}
-	}
-	return curr;
-}
-
 camera::camera(const double &yaw, const double &pit, const double &dist)
 	: yaw{ yaw }
 	, pit{ pit }
@@ -164,7 +149,6 @@ void engine_t::run()
 
 void engine_t::init_engine()
 {
-	srand(_seed);
 	world = new world_t(_seed);
 	std::cout << "World generated with seed: " << _seed << std::endl;
 
@@ -252,6 +236,23 @@ void engine_t::render_world()
 	glColor3ub(255, 255, 255);
 	draw_string("Pitch: " + std::to_string(_cam->pit) + "\nYaw: " + std::to_string(_cam->yaw), 5, 10, 10);
 
+	// biomes of every land face are evaluated up front, spread over the thread pool
+	std::vector<unsigned char> biome_colors;
+	if (mode == MODE_FLAT) {
+		std::vector<surface_t *> faces = world->get_faces();
+		biome_colors.assign(faces.size() * 3, 0);
+		parallel_for(faces.size(), [&](const size_t &from, const size_t &to) {
+			for (size_t i = from; i < to; i++) {
+				if (faces[i]->type != surface_t::FACE_LAND)
+					continue;
+				biome_t biome = world->get_biome(faces[i]);
+				biome_colors[faces[i]->ID * 3] = biome.r;
+				biome_colors[faces[i]->ID * 3 + 1] = biome.g;
+				biome_colors[faces[i]->ID * 3 + 2] = biome.b;
+			}
+		});
+	}
+
 	// set ocean color
 	glColor3ub(26, 26, 102);
 
@@ -272,22 +273,20 @@ void engine_t::render_world()
 					case MODE_LANDMASS:
 						glColor3d(s->landmass->r, s->landmass->g, s->landmass->b);
 						break;
-					case MODE_FLAT: {
-						auto biome = s->get_biome();
-						glColor3ub(biome.r, biome.g, biome.b);
+					case MODE_FLAT:
+						glColor3ub(biome_colors[s->ID * 3], biome_colors[s->ID * 3 + 1], biome_colors[s->ID * 3 + 2]);
 						break;
-					}
 					case MODE_ARIDITY:
-						glColor3d(s->aridity - 2.0, 1.0 - std::abs(s->aridity - 2.0), 1.0 - std::abs(s->aridity - 1.0));
+						glColor3d(world->get_aridity(s) - 2.0, 1.0 - std::abs(world->get_aridity(s) - 2.0), 1.0 - std::abs(world->get_aridity(s) - 1.0));
 						break;
 					case MODE_HEIGHT:
 						glColor3d(s->height - 2.0, 1.0 - std::abs(s->height - 2.0), 1.0 - std::abs(s->height - 1.0));
 						break;
 					case MODE_FOEHN:
-						glColor3d(s->foehn - 2.0, 1.0 - std::abs(s->foehn - 2.0), 1.0 - std::abs(s->foehn - 1.0));
+						glColor3d(world->get_foehn(s) - 2.0, 1.0 - std::abs(world->get_foehn(s) - 2.0), 1.0 - std::abs(world->get_foehn(s) - 1.0));
 						break;
 					case MODE_DATA:
-						glColor3d(s->aridity, s->height, s->foehn);
+						glColor3d(world->get_aridity(s), s->height, world->get_foehn(s));
 						break;
 				}
 				glBegin(GL_TRIANGLES);
@@ -334,7 +333,7 @@ void engine_t::render_world()
 				m_y
 			);
 
-			_selected = get_face_from_point(mp, world->get_faces());
+			_selected = world->find_closest(mp[0], mp[1]);
 			if (_selected != NULL) {
 				glColor3d(1.0, 0.0, 0.0);
 				if (_selected->b[0] * _selected->a[1] + _selected->c[0] * _selected->b[1] + _selected->a[0] * _selected->c[1] > _selected->a[0] * _selected->b[1] + _selected->b[0] * _selected->c[1] + _selected->c[0] * _selected->a[1]) {
@@ -410,22 +409,20 @@ void engine_t::render_world()
 					case MODE_LANDMASS:
 						glColor3d(s->landmass->r, s->landmass->g, s->landmass->b);
 						break;
-					case MODE_FLAT: {
-						auto biome = s->get_biome();
-						glColor3ub(biome.r, biome.g, biome.b);
+					case MODE_FLAT:
+						glColor3ub(biome_colors[s->ID * 3], biome_colors[s->ID * 3 + 1], biome_colors[s->ID * 3 + 2]);
 						break;
-					}
 					case MODE_ARIDITY:
-						glColor3d(s->aridity - 2.0, 1.0 - std::abs(s->aridity - 2.0), 1.0 - std::abs(s->aridity - 1.0));
+						glColor3d(world->get_aridity(s) - 2.0, 1.0 - std::abs(world->get_aridity(s) - 2.0), 1.0 - std::abs(world->get_aridity(s) - 1.0));
 						break;
 					case MODE_HEIGHT:
 						glColor3d(s->height - 2.0, 1.0 - std::abs(s->height - 2.0), 1.0 - std::abs(s->height - 1.0));
 						break;
 					case MODE_FOEHN:
-						glColor3d(s->foehn - 2.0, 1.0 - std::abs(s->foehn - 2.0), 1.0 - std::abs(s->foehn - 1.0));
+						glColor3d(world->get_foehn(s) - 2.0, 1.0 - std::abs(world->get_foehn(s) - 2.0), 1.0 - std::abs(world->get_foehn(s) - 1.0));
 						break;
 					case MODE_DATA:
-						glColor3d(s->aridity, s->height, s->foehn);
+						glColor3d(world->get_aridity(s), s->height, world->get_foehn(s));
 						break;
 				}
 				draw_shape(s);
@@ -444,7 +441,7 @@ void engine_t::render_world()
 				180.0 * std::asin(test[2] / r) / M_PI + 90.0
 			);
 
-			_selected = get_face_from_point(mp, world->get_faces());
+			_selected = world->find_closest(mp[0], mp[1]);
 			if (_selected != NULL) {
 				glColor3d(1.0, 0.0, 0.0);
 				glBegin(GL_LINE_LOOP);
@@ -496,12 +493,28 @@ void engine_t::user_input()
 				break;
 			case SDL_MOUSEBUTTONDOWN:
 				if (evnt.button.button == SDL_BUTTON_LEFT && _selected != NULL) {
-					std::cout << _selected->get_biome().name << "\n";
-					std::cout << "HEIGHT: " << _selected->height << "\nARIDITY: " << _selected->aridity << "\nFOEHN: " << _selected->foehn << "\n";
+					std::cout << world->get_biome(_selected).name << "\n";
+					std::cout << "HEIGHT: " << _selected->height << "\nARIDITY: " << world->get_aridity(_selected) << "\nFOEHN: " << world->get_foehn(_selected) << "\n";
 					std::cout << "A: (" << _selected->a[0] << ", " << _selected->a[1] << ")\n";
 					std::cout << "B: (" << _selected->b[0] << ", " << _selected->b[1] << ")\n";
 					std::cout << "C: (" << _selected->c[0] << ", " << _selected->c[1] << ")\n";
 				}
+				if (evnt.button.button == SDL_BUTTON_RIGHT && _selected != NULL) {
+					// raise the selected face and its neighbors, lowering them with shift held
+					double step = keystate[SDL_SCANCODE_LSHIFT] ? -0.05 : 0.05;
+					std::vector<terrain_edit_t> brush;
+					std::vector<surface_t *> area(_selected->neighbors.begin(), _selected->neighbors.end());
+					area.push_back(_selected);
+					// only the height changes, so springs stay springs and land stays land
+					for (auto &f : area)
+						brush.push_back({ f, MAX<double>(0.0, f->height + step), world->get_terrain(f) });
+					std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+					size_t touched = world->edit(brush);
+					std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+					std::cout << "EDITED: " << touched << " faces in "
+						<< std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()
+						<< "[us]\n";
+				}
 			case SDL_KEYDOWN:
 				switch (evnt.key.keysym.scancode) {
 					case SDL_SCANCODE_O: {
@@ -627,7 +640,7 @@ void engine_t::serialize(const std::string &filename)
 {
 	std::ofstream file(filename);
 	for (auto &s : world->get_faces()) {
-		file << s->ID << "\t" << s->type << "\t" << s->height << "\t" << s->aridity << "\t" << s->foehn << "\t" << s->a[0] << "\t" << s->a[1] << "\t" << s->b[0] << "\t" << s->b[1] << "\t" << s->c[0] << "\t" << s->c[1];
+		file << s->ID << "\t" << s->type << "\t" << s->height << "\t" << world->get_aridity(s) << "\t" << world->get_foehn(s) << "\t" << s->a[0] << "\t" << s->a[1] << "\t" << s->b[0] << "\t" << s->b[1] << "\t" << s->c[0] << "\t" << s->c[1];
 		for (auto &n : s->neighbors) {
 			file << "\t" << n->ID;
 		}
@@ -0,0 +1,131 @@
+#include "erosion.h"
+
+#include "../column/column.h"
+#include "../parallel/parallel.h"
+
+static const double RAIN = 0.01;
+static const double EVAPORATION = 0.05;
+static const double CAPACITY = 0.5;
+static const double DISSOLVING = 0.1;
+static const double DEPOSITION = 0.1;
+static const double MIN_SLOPE = 0.05;
+static const double TALUS = 4.0;
+static const double SLUMPING = 0.1;
+
+void erode(const std::vector<surface_t *> &faces, const int &iterations, progress_t *progress)
+{
+	const size_t N = faces.size();
+
+	// neighbor slots of face i are first[i]..first[i + 1], twin[k] is the slot pointing back
+	column_vector_t<unsigned int> first(N + 1, 0);
+	column_vector_t<unsigned int> adjacent;
+	column_vector_t<double> length;
+	for (size_t i = 0; i < N; i++) {
+		for (auto &n : faces[i]->neighbors) {
+			adjacent.push_back(n->ID);
+			length.push_back(MAX<double>(1e-6, std::acos(CLAMP<double>(glm::dot(faces[i]->get_center_c().coords, n->get_center_c().coords), -1.0, 1.0))));
+		}
+		first[i + 1] = adjacent.size();
+	}
+	column_vector_t<unsigned int> twin(adjacent.size(), 0);
+	parallel_for(N, [&](const size_t &from, const size_t &to) {
+		for (size_t i = from; i < to; i++) {
+			for (unsigned int k = first[i]; k < first[i + 1]; k++) {
+				unsigned int j = adjacent[k];
+				for (unsigned int t = first[j]; t < first[j + 1]; t++) {
+					if (adjacent[t] == i)
+						twin[k] = t;
+				}
+			}
+		}
+	});
+
+	column_vector_t<char> ground(N);
+	column_vector_t<double> height(N), water(N, 0), sediment(N, 0);
+	for (size_t i = 0; i < N; i++) {
+		ground[i] = faces[i]->type == surface_t::FACE_LAND || faces[i]->type == surface_t::FACE_FLOWING;
+		height[i] = faces[i]->height;
+	}
+	column_vector_t<double> next_height(height), next_water(N, 0), next_sediment(N, 0);
+	column_vector_t<double> flux(adjacent.size(), 0), carried(adjacent.size(), 0);
+
+	auto rained = [&](const size_t &i) { return water[i] + (ground[i] ? RAIN : 0); };
+
+	for (int it = 0; it < iterations; it++) {
+		if (stopped(progress))
+			return;
+		report(progress, (double)it / iterations);
+		// water leaves towards lower water surfaces, at most half the height difference at once
+		parallel_for(N, [&](const size_t &from, const size_t &to) {
+			for (size_t i = from; i < to; i++) {
+				double total = 0;
+				for (unsigned int k = first[i]; k < first[i + 1]; k++) {
+					flux[k] = 0;
+					carried[k] = 0;
+					if (!ground[i])
+						continue;
+					unsigned int j = adjacent[k];
+					flux[k] = MAX<double>(0, height[i] + rained(i) - height[j] - rained(j));
+					total += flux[k];
+				}
+				if (total <= 0)
+					continue;
+				double w = rained(i);
+				double s = MIN<double>(w, total / 2.0) / total;
+				for (unsigned int k = first[i]; k < first[i + 1]; k++) {
+					flux[k] *= s;
+					carried[k] = sediment[i] * flux[k] / w;
+				}
+			}
+		});
+
+		parallel_for(N, [&](const size_t &from, const size_t &to) {
+			for (size_t i = from; i < to; i++) {
+				if (!ground[i]) {
+					next_height[i] = height[i];
+					continue;
+				}
+				double w = rained(i);
+				double s = sediment[i];
+				double capacity = 0;
+				double slump = 0;
+				for (unsigned int k = first[i]; k < first[i + 1]; k++) {
+					unsigned int j = adjacent[k];
+					w -= flux[k];
+					s -= carried[k];
+					capacity += flux[k] * MAX<double>(MIN_SLOPE, (height[i] - height[j]) / length[k]);
+					if (ground[j]) {
+						w += flux[twin[k]];
+						s += carried[twin[k]];
+						slump += MAX<double>(0, height[j] - height[i] - TALUS * length[k]);
+					}
+					slump -= MAX<double>(0, height[i] - height[j] - TALUS * length[k]);
+				}
+				capacity *= CAPACITY;
+
+				double h = height[i] + SLUMPING * slump;
+				if (s > capacity) {
+					double d = DEPOSITION * (s - capacity);
+					h += d;
+					s -= d;
+				} else {
+					double d = MIN<double>(h, DISSOLVING * (capacity - s));
+					h -= d;
+					s += d;
+				}
+				next_height[i] = MAX<double>(0, h);
+				next_water[i] = MAX<double>(0, w) * (1.0 - EVAPORATION);
+				next_sediment[i] = MAX<double>(0, s);
+			}
+		});
+
+		height.swap(next_height);
+		water.swap(next_water);
+		sediment.swap(next_sediment);
+	}
+
+	for (size_t i = 0; i < N; i++) {
+		if (ground[i])
+			faces[i]->height = height[i];
+	}
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <vector>
+
+#include "../surface/surface.h"
+#include "../progress/progress.h"
+
+/*
+ * Thermal slumping plus flux-based hydraulic erosion of the land heights.
+ * The neighbor graph is flattened into index arrays first, and each iteration
+ * is two data-parallel passes: every face computes what leaves it, then every
+ * face gathers what arrives, so the result does not depend on thread count.
+ * Ocean faces are fixed base level and swallow whatever flows into them.
+ */
+void erode(const std::vector<surface_t *> &, const int &, progress_t * = NULL);
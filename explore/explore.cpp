@@ -0,0 +1,100 @@
+#include "explore.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+
+#include "../label/label.h"
+#include "../parallel/parallel.h"
+
+static const char *BIOME_LABELS[BIOME_TYPE_COUNT] = { "wet", "desert", "scrub", "forest", "rain", "tundra", "polar", "water" };
+
+seed_score_t score_world(const int &seed, world_t &world)
+{
+	seed_score_t score;
+	score.seed = seed;
+
+	std::vector<surface_t *> faces = world.get_faces();
+	double total = 0;
+	double land = 0;
+	for (auto &f : faces) {
+		double area = f->get_area();
+		total += area;
+		if (f->type == surface_t::FACE_LAND)
+			land += area;
+		score.biomes[world.get_biome(f).type] += area;
+	}
+	score.land_fraction = land / total;
+	for (auto &b : score.biomes)
+		b /= total;
+
+	for (auto &l : world.get_landmasses())
+		score.landmasses.push_back(land > 0 ? l->area / land : 0);
+	std::sort(score.landmasses.begin(), score.landmasses.end(), std::greater<double>());
+
+	score.rivers = components_t(faces, surface_t::FACE_INLAND_LAKE).components.size();
+
+	// Shannon entropy of the land biomes, pulled down the further land is from the target
+	double entropy = 0;
+	double dry = 1.0 - score.biomes[biome_t::WATER];
+	for (int b = 0; b < biome_t::WATER; b++) {
+		double p = dry > 0 ? score.biomes[b] / dry : 0;
+		if (p > 0)
+			entropy -= p * std::log(p);
+	}
+	score.score = entropy * MAX<double>(0.0, 1.0 - 2.0 * std::abs(score.land_fraction - EXPLORE_LAND_TARGET));
+	return score;
+}
+
+exploration_t explore_seeds(const std::vector<int> &seeds, const world_config_t &config)
+{
+	exploration_t exploration;
+	exploration.scores.resize(seeds.size());
+
+	world_config_t coarse = config.resized(EXPLORE_FACE_SIZE);
+	coarse.cache_directory.clear();
+	coarse.verbose = false;
+
+	exploration.threads = MIN<size_t>(get_thread_count(), seeds.size());
+
+	// one coarse world per pool thread; its own loops nest on the same pool, so no thread is added
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	std::atomic<size_t> next{ 0 };
+	thread_pool_t::get().run(exploration.threads, [&](const size_t &) {
+		world_t world(EXPLORE_MESH_SEED, coarse);
+		for (size_t i = next++; i < seeds.size(); i = next++) {
+			world.reseed(seeds[i]);
+			exploration.scores[i] = score_world(seeds[i], world);
+		}
+	});
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	exploration.seconds = std::chrono::duration<double>(end - begin).count();
+
+	std::stable_sort(exploration.scores.begin(), exploration.scores.end(), [](const seed_score_t &a, const seed_score_t &b) {
+		return a.score > b.score || (a.score == b.score && a.seed < b.seed);
+	});
+	return exploration;
+}
+
+void print_scores(std::ostream &out, const exploration_t &exploration, const size_t &limit)
+{
+	out << "rank\tseed\tscore\tland\tmasses\tlargest\trivers";
+	for (auto &label : BIOME_LABELS)
+		out << "\t" << label;
+	out << "\n";
+	out << std::fixed << std::setprecision(3);
+	for (size_t i = 0; i < MIN<size_t>(limit, exploration.scores.size()); i++) {
+		const seed_score_t &s = exploration.scores[i];
+		out << i + 1 << "\t" << s.seed << "\t" << s.score << "\t" << s.land_fraction << "\t" << s.landmasses.size()
+			<< "\t" << (s.landmasses.empty() ? 0.0 : s.landmasses[0]) << "\t" << s.rivers;
+		for (auto &b : s.biomes)
+			out << "\t" << b;
+		out << "\n";
+	}
+	out << std::defaultfloat;
+	out << exploration.scores.size() << " seeds in " << exploration.seconds << "s on " << exploration.threads << " threads: "
+		<< exploration.scores.size() / exploration.seconds << " seeds/s, "
+		<< exploration.scores.size() / exploration.seconds / exploration.threads << " seeds/s per thread\n";
+}
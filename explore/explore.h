@@ -0,0 +1,53 @@
+#pragma once
+
+/* -------- OPTIONS --------- */
+
+#define EXPLORE_FACE_SIZE		4
+#define EXPLORE_MESH_SEED		0
+#define EXPLORE_LAND_TARGET		0.3
+
+/* -------------------------- */
+
+#include <ostream>
+#include <vector>
+
+#include "../world/world.h"
+
+static constexpr int BIOME_TYPE_COUNT = biome_t::WATER + 1;
+
+/*
+ * Summary of one generated world. Areas are fractions: land of the whole
+ * sphere, landmasses of the land (largest first) and biomes of the whole
+ * sphere, binned by biome_t::biome_type. Rivers are carved into inland lake
+ * faces, so they are counted as connected systems of inland water.
+ */
+struct seed_score_t
+{
+	int seed = 0;
+	double score = 0;
+	double land_fraction = 0;
+	std::vector<double> landmasses;
+	double biomes[BIOME_TYPE_COUNT] = {};
+	size_t rivers = 0;
+};
+
+struct exploration_t
+{
+	std::vector<seed_score_t> scores;
+	size_t threads = 0;
+	double seconds = 0;
+};
+
+/*
+ * Scores many seeds at a coarse resolution, ranked best first. Every pool thread
+ * builds one coarse mesh from EXPLORE_MESH_SEED and reseeds the same world
+ * for each seed it takes, so a seed costs the stages after the mesh and
+ * nothing else, and its score does not depend on which thread ran it. The
+ * configuration is resized to EXPLORE_FACE_SIZE and islands start at points
+ * on the sphere, not at face IDs, so a coarse world lays out its land like
+ * the full world of the same seed, if a little more of it. The default score
+ * favors diverse biomes on about EXPLORE_LAND_TARGET land.
+ */
+seed_score_t score_world(const int &, world_t &);
+exploration_t explore_seeds(const std::vector<int> &, const world_config_t &);
+void print_scores(std::ostream &, const exploration_t &, const size_t &);
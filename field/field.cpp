@@ -0,0 +1,178 @@
+#include "field.h"
+
+#include <algorithm>
+#include <queue>
+#include <unordered_map>
+
+struct field_entry_t
+{
+	double path;
+	unsigned long long source;
+	unsigned long long face;
+
+	const bool operator>(const field_entry_t &e) const
+	{
+		if (path != e.path)
+			return path > e.path;
+		if (source != e.source)
+			return source > e.source;
+		return face > e.face;
+	}
+};
+
+double face_arc(const surface_t *a, const surface_t *b)
+{
+	return std::acos(CLAMP<double>(glm::dot(a->get_center_c().coords, b->get_center_c().coords), -1.0, 1.0));
+}
+
+typedef std::priority_queue<field_entry_t, std::vector<field_entry_t>, std::greater<field_entry_t>> field_queue_t;
+
+// sources are ordered by walked path length along the neighbor graph, ties going to the lower source ID,
+// so the labeling only depends on the graph and never on the order faces are visited in
+static void relax(const std::vector<surface_t *> &faces, column_vector_t<surface_t *> &nearest, column_vector_t<double> &path, field_queue_t &open, std::vector<surface_t *> *settled, progress_t *progress)
+{
+	while (!open.empty()) {
+		if (stopped(progress))
+			return;
+		field_entry_t e = open.top();
+		open.pop();
+		if (e.path > path[e.face] || nearest[e.face]->ID != e.source)
+			continue;
+		surface_t *curr = faces[e.face];
+		if (settled != NULL)
+			settled->push_back(curr);
+		for (auto &n : curr->neighbors) {
+			double t = e.path + face_arc(curr, n);
+			if (t < path[n->ID] || (t == path[n->ID] && e.source < nearest[n->ID]->ID)) {
+				path[n->ID] = t;
+				nearest[n->ID] = nearest[e.face];
+				open.push({ t, e.source, n->ID });
+			}
+		}
+	}
+}
+
+distance_field_t::distance_field_t(const std::vector<surface_t *> &faces, const surface_t::surface_type &type, progress_t *progress)
+	: type(type)
+	, nearest(faces.size(), NULL)
+	, distance(faces.size(), INFINITY)
+	, path(faces.size(), INFINITY)
+{
+	field_queue_t open;
+	for (auto &f : faces) {
+		if (f->type != type)
+			continue;
+		path[f->ID] = 0;
+		nearest[f->ID] = f;
+		open.push({ 0, f->ID, f->ID });
+	}
+	relax(faces, nearest, path, open, NULL, progress);
+
+	// the walked path only picks the source, the recorded distance is the great-circle one
+	for (auto &f : faces) {
+		if (nearest[f->ID] == f)
+			distance[f->ID] = 0;
+		else if (nearest[f->ID] != NULL)
+			distance[f->ID] = face_arc(f, nearest[f->ID]);
+	}
+}
+
+distance_field_t::distance_field_t(const surface_t::surface_type &type, const size_t &count)
+	: type(type)
+	, nearest(count, NULL)
+	, distance(count, INFINITY)
+	, path(count, INFINITY)
+{
+}
+
+std::vector<surface_t *> distance_field_t::repair(const std::vector<surface_t *> &faces, const std::vector<surface_t *> &changed)
+{
+	std::vector<surface_t *> cleared;
+	field_queue_t open;
+
+	// a face is stale exactly when its source lost the type, and stale faces form connected cells around those sources
+	for (auto &f : changed) {
+		if (nearest[f->ID] == f && f->type != type) {
+			nearest[f->ID] = NULL;
+			path[f->ID] = INFINITY;
+			cleared.push_back(f);
+		}
+	}
+	for (size_t i = 0; i < cleared.size(); i++) {
+		for (auto &n : cleared[i]->neighbors) {
+			if (nearest[n->ID] != NULL && nearest[n->ID]->type != type) {
+				nearest[n->ID] = NULL;
+				path[n->ID] = INFINITY;
+				cleared.push_back(n);
+			}
+		}
+	}
+
+	// refill from the intact border of the cleared cells and from the new sources
+	for (auto &f : cleared) {
+		for (auto &n : f->neighbors) {
+			if (nearest[n->ID] != NULL)
+				open.push({ path[n->ID], nearest[n->ID]->ID, n->ID });
+		}
+	}
+	for (auto &f : changed) {
+		if (f->type == type && nearest[f->ID] != f) {
+			path[f->ID] = 0;
+			nearest[f->ID] = f;
+			open.push({ 0, f->ID, f->ID });
+		}
+	}
+
+	std::vector<surface_t *> settled;
+	relax(faces, nearest, path, open, &settled, NULL);
+	settled.insert(settled.end(), cleared.begin(), cleared.end());
+	std::sort(settled.begin(), settled.end(), [](const surface_t *a, const surface_t *b) {
+		return a->ID < b->ID;
+	});
+	settled.erase(std::unique(settled.begin(), settled.end()), settled.end());
+
+	for (auto &f : settled) {
+		if (nearest[f->ID] == f)
+			distance[f->ID] = 0;
+		else if (nearest[f->ID] != NULL)
+			distance[f->ID] = face_arc(f, nearest[f->ID]);
+		else
+			distance[f->ID] = INFINITY;
+	}
+	return settled;
+}
+
+std::pair<surface_t *, double> distance_field_t::operator[](const surface_t *f) const
+{
+	return { nearest[f->ID], distance[f->ID] };
+}
+
+std::pair<surface_t *, double> walk_nearest(surface_t *f, const surface_t::surface_type &type)
+{
+	// walked paths are symmetric, so the first source settled from f is the one the field would give f,
+	// and settling ties by face ID keeps the field's tie break towards the lower source ID
+	typedef std::pair<double, unsigned long long> entry_t;
+	std::priority_queue<std::pair<entry_t, surface_t *>, std::vector<std::pair<entry_t, surface_t *>>, std::greater<std::pair<entry_t, surface_t *>>> open;
+	std::unordered_map<unsigned long long, double> path;
+
+	path[f->ID] = 0;
+	open.push({ { 0, f->ID }, f });
+	while (!open.empty()) {
+		entry_t e = open.top().first;
+		surface_t *curr = open.top().second;
+		open.pop();
+		if (e.first > path[curr->ID])
+			continue;
+		if (curr->type == type)
+			return { curr, curr == f ? 0 : face_arc(f, curr) };
+		for (auto &n : curr->neighbors) {
+			double t = e.first + face_arc(curr, n);
+			auto it = path.find(n->ID);
+			if (it == path.end() || t < it->second) {
+				path[n->ID] = t;
+				open.push({ { t, n->ID }, n });
+			}
+		}
+	}
+	return { NULL, INFINITY };
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+
+#include "../surface/surface.h"
+#include "../column/column.h"
+#include "../progress/progress.h"
+
+/*
+ * Nearest face of a given type for every face of the world, built with one
+ * multi-source pass over the neighbor graph instead of a find_nearest per face.
+ * Fields are indexed by surface_t::ID, so faces must be numbered 0..N-1.
+ *
+ * repair() brings the field up to date after some faces changed type: faces
+ * whose source is gone are cleared and refilled from the intact faces around
+ * them, and new sources only spread as far as they beat the old ones. It
+ * returns every face whose entry was recomputed. A cancelled progress stops
+ * the constructor's pass early and leaves the field partial. A field given
+ * only a type and a face count starts out empty, for filling in elsewhere.
+ */
+struct distance_field_t
+{
+	surface_t::surface_type type;
+	column_vector_t<surface_t *> nearest;
+	column_vector_t<double> distance;
+	column_vector_t<double> path;
+
+	distance_field_t(const std::vector<surface_t *> &, const surface_t::surface_type &, progress_t * = NULL);
+	distance_field_t(const surface_t::surface_type &, const size_t &);
+	std::vector<surface_t *> repair(const std::vector<surface_t *> &, const std::vector<surface_t *> &);
+	std::pair<surface_t *, double> operator[](const surface_t *) const;
+};
+
+/* great-circle distance between two face centers, the step length fields walk with */
+double face_arc(const surface_t *, const surface_t *);
+
+/*
+ * The same nearest face as distance_field_t would record for one face, found by
+ * walking out from that face alone until the first face of the type is
+ * settled. Cheaper than a whole field when only a few faces are asked for.
+ */
+std::pair<surface_t *, double> walk_nearest(surface_t *, const surface_t::surface_type &);
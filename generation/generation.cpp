@@ -0,0 +1,47 @@
+#include "generation.h"
+
+generation_t::generation_t(const int &seed, const world_config_t &config, const progress_callback_t &callback)
+	: progress(callback)
+{
+	worker = std::thread([this, seed, config]() {
+		world_t *w = new world_t(seed, config, &progress);
+		if (progress.stopped()) {
+			delete w;
+			w = NULL;
+		}
+		world = w;
+		finished.store(true, std::memory_order_release);
+	});
+}
+
+generation_t::~generation_t()
+{
+	cancel();
+	if (worker.joinable())
+		worker.join();
+	delete world;
+}
+
+void generation_t::cancel()
+{
+	progress.cancelled.store(true);
+}
+
+bool generation_t::done() const
+{
+	return finished.load(std::memory_order_acquire);
+}
+
+world_t *generation_t::wait()
+{
+	if (worker.joinable())
+		worker.join();
+	// a cancel that came in after the last stage still wins
+	if (progress.stopped()) {
+		delete world;
+		world = NULL;
+	}
+	world_t *w = world;
+	world = NULL;
+	return w;
+}
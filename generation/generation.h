@@ -0,0 +1,30 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+
+#include "../world/world.h"
+#include "../progress/progress.h"
+
+/*
+ * A world generated on a thread of its own. The callback reports every stage
+ * from that thread. cancel() makes the running stage stop at its next check,
+ * and the generation thread deletes the half built world as soon as it has
+ * stopped, so abandoned work gives its memory back without waiting for
+ * anyone to call wait(). wait() hands over the finished world, or NULL when
+ * the generation was cancelled; the destructor cancels and joins.
+ */
+struct generation_t
+{
+private:
+	progress_t progress;
+	std::atomic<bool> finished{ false };
+	world_t *world = NULL;
+	std::thread worker;
+public:
+	generation_t(const int &, const world_config_t & = world_config_t(), const progress_callback_t & = NULL);
+	~generation_t();
+	void cancel();
+	bool done() const;
+	world_t *wait();
+};
@@ -0,0 +1,74 @@
+#include "hierarchy.h"
+
+#include <cmath>
+
+world_hierarchy_t::world_hierarchy_t(const int &seed, const world_config_t &config, const size_t &count, progress_t *progress)
+{
+	for (size_t k = 0; k < count && !stopped(progress); k++) {
+		// parameters counted in faces shrink with the level, so islands and lakes keep their size on the sphere
+		world_config_t c = config.resized(config.face_size * std::ldexp(1.0, count - 1 - k));
+		world_t *level = levels.empty() ? new world_t(seed, c, progress) : new world_t(*levels.back(), c, progress);
+		// a level cut short is only good for deleting
+		if (stopped(progress)) {
+			delete level;
+			break;
+		}
+		levels.push_back(level);
+	}
+
+	// children by counting sort over the parents of the next level
+	child_start.resize(levels.size());
+	child_faces.resize(levels.size());
+	for (size_t k = 0; k + 1 < levels.size(); k++) {
+		const std::vector<surface_t *> &coarse = levels[k]->get_faces();
+		const std::vector<surface_t *> &fine = levels[k + 1]->get_faces();
+		std::vector<uint32_t> &start = child_start[k];
+		start.assign(coarse.size() + 1, 0);
+		for (auto &f : fine)
+			start[levels[k + 1]->get_parent(f)->ID + 1]++;
+		for (size_t i = 0; i < coarse.size(); i++)
+			start[i + 1] += start[i];
+		child_faces[k].resize(fine.size());
+		std::vector<uint32_t> fill(start.begin(), start.end() - 1);
+		for (auto &f : fine)
+			child_faces[k][fill[levels[k + 1]->get_parent(f)->ID]++] = f->ID;
+	}
+}
+
+world_hierarchy_t::~world_hierarchy_t()
+{
+	// finest first, since every level reads the one before it
+	for (size_t k = levels.size(); k-- > 0;)
+		delete levels[k];
+}
+
+size_t world_hierarchy_t::get_level_count() const
+{
+	return levels.size();
+}
+
+world_t *world_hierarchy_t::get_level(const size_t &k) const
+{
+	return levels[k];
+}
+
+world_t *world_hierarchy_t::get_finest() const
+{
+	return levels.empty() ? NULL : levels.back();
+}
+
+surface_t *world_hierarchy_t::get_parent(const size_t &k, const surface_t *f) const
+{
+	return k == 0 ? NULL : levels[k]->get_parent(f);
+}
+
+std::vector<surface_t *> world_hierarchy_t::get_children(const size_t &k, const surface_t *f) const
+{
+	std::vector<surface_t *> children;
+	if (k + 1 >= levels.size())
+		return children;
+	const std::vector<surface_t *> &fine = levels[k + 1]->get_faces();
+	for (uint32_t i = child_start[k][f->ID]; i < child_start[k][f->ID + 1]; i++)
+		children.push_back(fine[child_faces[k][i]]);
+	return children;
+}
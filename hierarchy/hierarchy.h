@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "../world/world.h"
+
+/*
+ * One seed at a ladder of face sizes, each level half the face size of the
+ * one before it, so about four times the faces. Island branching and the
+ * inland lake size count faces, so coarser levels get them scaled down to
+ * keep land and lakes the same size on the sphere. Level 0 is generated like
+ * any world; every later level refines the level before it, and keeps a link
+ * from each of its faces to its parent there. Since every level holds about a
+ * quarter of the faces of the next, building all of them costs about 4/3 of
+ * building the finest one. Parents and children are read by level and face
+ * ID, level 0 being the coarsest; faces of level 0 have no parent and faces
+ * of the finest level no children. Levels left unbuilt when progress is
+ * stopped are missing from the hierarchy.
+ */
+struct world_hierarchy_t
+{
+	world_hierarchy_t(const int &, const world_config_t &, const size_t &, progress_t * = NULL);
+	~world_hierarchy_t();
+
+	size_t get_level_count() const;
+	world_t *get_level(const size_t &) const;
+	world_t *get_finest() const;
+	surface_t *get_parent(const size_t &, const surface_t *) const;
+	std::vector<surface_t *> get_children(const size_t &, const surface_t *) const;
+
+private:
+	std::vector<world_t *> levels;
+	// children of level k, by face of level k, as ranges into child_faces[k]
+	std::vector<std::vector<uint32_t>> child_start;
+	std::vector<std::vector<uint32_t>> child_faces;
+};
@@ -0,0 +1,152 @@
+#include "hydrology.h"
+
+#include <algorithm>
+#include <queue>
+
+#include "../traverse/traverse.h"
+
+struct flood_entry_t
+{
+	double filled;
+	unsigned int steps;
+	unsigned long long face;
+
+	const bool operator>(const flood_entry_t &e) const
+	{
+		if (filled != e.filled)
+			return filled > e.filled;
+		if (steps != e.steps)
+			return steps > e.steps;
+		return face > e.face;
+	}
+};
+
+hydrology_t::hydrology_t(const std::vector<surface_t *> &faces, progress_t *progress)
+	: hydrology_t(faces, faces, progress)
+{
+}
+
+hydrology_t::hydrology_t(const std::vector<surface_t *> &faces, const std::vector<surface_t *> &region, progress_t *progress)
+	: filled(faces.size(), INFINITY)
+	, steps(faces.size(), 0)
+	, receiver(faces.size(), NULL)
+	, flow(faces.size(), 0)
+{
+	// faces outside the region start out done so the flood never enters them
+	column_vector_t<unsigned char> done(faces.size(), region.size() != faces.size());
+	for (auto &f : region)
+		done[f->ID] = false;
+	std::priority_queue<flood_entry_t, std::vector<flood_entry_t>, std::greater<flood_entry_t>> open;
+
+	for (auto &f : region) {
+		if (f->type != surface_t::FACE_OCEAN)
+			continue;
+		filled[f->ID] = f->height;
+		open.push({ f->height, 0, f->ID });
+	}
+
+	// faces are settled in increasing (filled, steps, ID), so `order` runs from the outlets upstream
+	order.reserve(region.size());
+	while (!open.empty()) {
+		if (stopped(progress))
+			return;
+		if (order.size() % 4096 == 0)
+			report(progress, (double)order.size() / region.size());
+		flood_entry_t e = open.top();
+		open.pop();
+		if (done[e.face])
+			continue;
+		done[e.face] = true;
+		surface_t *curr = faces[e.face];
+		order.push_back(curr);
+		for (auto &n : curr->neighbors) {
+			if (done[n->ID] || n->type == surface_t::FACE_OCEAN)
+				continue;
+			flood_entry_t c = { MAX<double>(n->height, e.filled), 0, n->ID };
+			if (c.filled == e.filled)
+				c.steps = e.steps + 1;
+			if (c.filled < filled[n->ID] || (c.filled == filled[n->ID] && c.steps < steps[n->ID])) {
+				filled[n->ID] = c.filled;
+				steps[n->ID] = c.steps;
+				open.push(c);
+			}
+		}
+	}
+
+	drain(region);
+}
+
+hydrology_t::hydrology_t(const std::vector<surface_t *> &faces, const std::vector<double> &filled, const std::vector<unsigned int> &steps)
+	: filled(filled.begin(), filled.end())
+	, steps(steps.begin(), steps.end())
+	, receiver(faces.size(), NULL)
+	, flow(faces.size(), 0)
+{
+	// the order the flood would have settled the faces in
+	for (auto &f : faces) {
+		if (filled[f->ID] != INFINITY)
+			order.push_back(f);
+	}
+	std::sort(order.begin(), order.end(), [&](const surface_t *a, const surface_t *b) {
+		return flood_entry_t{ filled[b->ID], steps[b->ID], b->ID } > flood_entry_t{ filled[a->ID], steps[a->ID], a->ID };
+	});
+	drain(faces);
+}
+
+void hydrology_t::drain(const std::vector<surface_t *> &region)
+{
+	for (auto &f : order) {
+		if (f->type == surface_t::FACE_OCEAN)
+			continue;
+		for (auto &n : f->neighbors) {
+			surface_t *r = receiver[f->ID];
+			if (r == NULL || flood_entry_t{ filled[r->ID], steps[r->ID], r->ID } > flood_entry_t{ filled[n->ID], steps[n->ID], n->ID })
+				receiver[f->ID] = n;
+		}
+	}
+
+	accumulate(region);
+}
+
+void hydrology_t::accumulate(const std::vector<surface_t *> &faces)
+{
+	// every spring adds one unit of flow to itself and everything downstream
+	std::fill(flow.begin(), flow.end(), 0);
+	for (auto &f : faces) {
+		if (f->type == surface_t::FACE_FLOWING)
+			flow[f->ID] = 1;
+	}
+	for (auto it = order.rbegin(); it != order.rend(); it++) {
+		surface_t *r = receiver[(*it)->ID];
+		if (r != NULL)
+			flow[r->ID] += flow[(*it)->ID];
+	}
+}
+
+void hydrology_t::carve(const std::vector<surface_t *> &faces, traversal_t &traversal, progress_t *progress) const
+{
+	// wet faces below their spill height belong to a lake filled up to that height,
+	// every other wet face is river running on to the next outlet
+	for (auto &f : faces) {
+		if (stopped(progress))
+			return;
+		if (f->type == surface_t::FACE_OCEAN || f->type == surface_t::FACE_STAGNANT || flow[f->ID] == 0)
+			continue;
+		if (receiver[f->ID] == NULL || f->height >= filled[f->ID]) {
+			f->type = surface_t::FACE_INLAND_LAKE;
+			continue;
+		}
+		const double level = filled[f->ID];
+		traversal.begin();
+		traversal.bfs(
+			std::vector<surface_t *>{ f },
+			[&](const surface_t *, const surface_t *n) {
+				return n->type != surface_t::FACE_OCEAN && filled[n->ID] == level && n->height < level;
+			},
+			[](surface_t *e) {
+				e->type = surface_t::FACE_STAGNANT;
+				return true;
+			}
+		);
+	}
+}
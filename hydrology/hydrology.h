@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+
+#include "../surface/surface.h"
+#include "../column/column.h"
+#include "../progress/progress.h"
+
+struct traversal_t;
+
+/*
+ * Drainage of every face towards the ocean, from one priority flood seeded at
+ * all FACE_OCEAN faces. Every face gets the lowest height water on it can
+ * spill out at (`filled`) and, within flat filled areas, its step count to the
+ * area's exit, so (filled, steps, ID) strictly decreases downstream and every
+ * face drains into its lowest-keyed neighbor. Fields are indexed by
+ * surface_t::ID; faces cut off from the ocean keep an infinite fill and no
+ * receiver.
+ *
+ * Drainage never crosses the ocean, so a region made of whole landmasses and
+ * the ocean faces bordering them can be flooded on its own; faces outside the
+ * region are left untouched. The flood can also be done elsewhere and handed
+ * in as the fill and step count of every face, which only leaves the drainage.
+ */
+struct hydrology_t
+{
+	column_vector_t<double> filled;
+	column_vector_t<unsigned int> steps;
+	column_vector_t<surface_t *> receiver;
+	column_vector_t<unsigned int> flow;
+	column_vector_t<surface_t *> order;
+
+	hydrology_t(const std::vector<surface_t *> &, progress_t * = NULL);
+	hydrology_t(const std::vector<surface_t *> &, const std::vector<surface_t *> &, progress_t * = NULL);
+	hydrology_t(const std::vector<surface_t *> &, const std::vector<double> &, const std::vector<unsigned int> &);
+	void accumulate(const std::vector<surface_t *> &);
+	void carve(const std::vector<surface_t *> &, traversal_t &, progress_t * = NULL) const;
+private:
+	void drain(const std::vector<surface_t *> &);
+};
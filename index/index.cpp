@@ -0,0 +1,303 @@
+#include "index.h"
+
+#include <algorithm>
+#include <queue>
+#include <tuple>
+
+static const double QUARTER_PI = M_PI / 4.0;
+
+static double angle(const double &x, const double &y, const double &z, const point3_t &p)
+{
+	double r = std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+	return std::acos(CLAMP<double>((x * p[0] + y * p[1] + z * p[2]) / r, -1.0, 1.0));
+}
+
+static bool closer(const std::pair<surface_t *, double> &a, const std::pair<surface_t *, double> &b)
+{
+	return a.second < b.second || (a.second == b.second && a.first->ID < b.first->ID);
+}
+
+size_t sphere_index_t::locate(const double &x, const double &y, const double &z, const int &level) const
+{
+	const double v[3] = { x, y, z };
+	int m = 0;
+	if (std::abs(v[1]) > std::abs(v[m]))
+		m = 1;
+	if (std::abs(v[2]) > std::abs(v[m]))
+		m = 2;
+	size_t face = m * 2 + (v[m] < 0 ? 1 : 0);
+	size_t side = (size_t)1 << level;
+	double a = std::abs(v[m]);
+	// atan warp keeps the cells of a cube face close to equal area on the sphere
+	double s = std::atan(v[(m + 1) % 3] / a) / QUARTER_PI;
+	double t = std::atan(v[(m + 2) % 3] / a) / QUARTER_PI;
+	size_t i = MIN<size_t>(side - 1, (size_t)((s + 1.0) / 2.0 * side));
+	size_t j = MIN<size_t>(side - 1, (size_t)((t + 1.0) / 2.0 * side));
+	return face * side * side + i * side + j;
+}
+
+void sphere_index_t::build(const std::vector<surface_t *> &faces)
+{
+	depth = 0;
+	while (6 * ((size_t)1 << (2 * depth)) * 8 < faces.size())
+		depth++;
+
+	level_offset.clear();
+	size_t total = 0;
+	for (int l = 0; l <= depth; l++) {
+		level_offset.push_back(total);
+		total += 6 * ((size_t)1 << (2 * l));
+	}
+
+	cells.assign(total, cell_t{ 0, 0, 0, 0 });
+	for (int l = 0; l <= depth; l++) {
+		size_t side = (size_t)1 << l;
+		for (size_t n = 0; n < 6 * side * side; n++) {
+			size_t face = n / (side * side);
+			int m = face / 2;
+			double s = std::tan((((n / side) % side + 0.5) / side * 2.0 - 1.0) * QUARTER_PI);
+			double t = std::tan(((n % side + 0.5) / side * 2.0 - 1.0) * QUARTER_PI);
+			double v[3];
+			v[m] = face % 2 == 0 ? 1.0 : -1.0;
+			v[(m + 1) % 3] = s;
+			v[(m + 2) % 3] = t;
+			double r = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+			cells[level_offset[l] + n] = cell_t{ v[0] / r, v[1] / r, v[2] / r, 0 };
+		}
+	}
+
+	members.assign(faces.begin(), faces.end());
+	leaf_of.assign(faces.size(), 0);
+	for (auto &f : faces) {
+		point3_t c = f->get_center_c();
+		leaf_of[f->ID] = locate(c[0], c[1], c[2], depth);
+		cell_t &leaf = cells[level_offset[depth] + leaf_of[f->ID]];
+		leaf.radius = MAX<double>(leaf.radius, angle(leaf.x, leaf.y, leaf.z, c));
+	}
+
+	sync();
+
+	// a parent cap has to cover the caps of every non-empty child
+	for (int l = depth - 1; l >= 0; l--) {
+		size_t side = (size_t)1 << l;
+		for (size_t n = 0; n < 6 * side * side; n++) {
+			cell_t &parent = cells[level_offset[l] + n];
+			size_t face = n / (side * side);
+			size_t i = (n / side) % side;
+			size_t j = n % side;
+			for (size_t c = 0; c < 4; c++) {
+				size_t child = level_offset[l + 1] + face * side * side * 4 + (2 * i + c / 2) * side * 2 + (2 * j + c % 2);
+				if (counts[child * SLOTS + surface_t::TYPE_COUNT] == 0)
+					continue;
+				const cell_t &sub = cells[child];
+				double d = std::acos(CLAMP<double>(parent.x * sub.x + parent.y * sub.y + parent.z * sub.z, -1.0, 1.0));
+				parent.radius = MAX<double>(parent.radius, d + sub.radius);
+			}
+		}
+	}
+}
+
+void sphere_index_t::sync()
+{
+	const int T = surface_t::TYPE_COUNT;
+	size_t leaves = 6 * ((size_t)1 << (2 * depth));
+
+	counts.assign(cells.size() * SLOTS, 0);
+	for (auto &f : members) {
+		size_t leaf = level_offset[depth] + leaf_of[f->ID];
+		counts[leaf * SLOTS + f->type]++;
+		counts[leaf * SLOTS + T]++;
+	}
+
+	bucket.assign(leaves * T + 1, 0);
+	for (size_t leaf = 0; leaf < leaves; leaf++) {
+		for (int t = 0; t < T; t++)
+			bucket[leaf * T + t + 1] = bucket[leaf * T + t] + counts[(level_offset[depth] + leaf) * SLOTS + t];
+	}
+
+	column_vector_t<unsigned int> cursor(bucket.begin(), bucket.end() - 1);
+	column_vector_t<surface_t *> sorted(members.size());
+	for (auto &f : members)
+		sorted[cursor[leaf_of[f->ID] * T + f->type]++] = f;
+	members.swap(sorted);
+
+	for (int l = depth - 1; l >= 0; l--) {
+		size_t side = (size_t)1 << l;
+		for (size_t n = 0; n < 6 * side * side; n++) {
+			size_t parent = level_offset[l] + n;
+			size_t face = n / (side * side);
+			size_t i = (n / side) % side;
+			size_t j = n % side;
+			for (size_t c = 0; c < 4; c++) {
+				size_t child = level_offset[l + 1] + face * side * side * 4 + (2 * i + c / 2) * side * 2 + (2 * j + c % 2);
+				for (int t = 0; t < SLOTS; t++)
+					counts[parent * SLOTS + t] += counts[child * SLOTS + t];
+			}
+		}
+	}
+}
+
+void sphere_index_t::retype(const surface_t *f, const surface_t::surface_type &from)
+{
+	const int T = surface_t::TYPE_COUNT;
+	const int to = f->type;
+	if (to == from)
+		return;
+
+	// members of a leaf are grouped by type, so the face hops one group boundary at a time
+	const size_t leaf = leaf_of[f->ID];
+	unsigned int *edge = &bucket[leaf * T];
+	size_t at = edge[from];
+	while (members[at] != f)
+		at++;
+	if (to > from) {
+		for (int t = from; t < to; t++) {
+			size_t last = edge[t + 1] - 1;
+			std::swap(members[at], members[last]);
+			edge[t + 1]--;
+			at = last;
+		}
+	} else {
+		for (int t = from; t > to; t--) {
+			size_t first = edge[t];
+			std::swap(members[at], members[first]);
+			edge[t]++;
+			at = first;
+		}
+	}
+
+	size_t n = leaf;
+	for (int l = depth; l >= 0; l--) {
+		counts[(level_offset[l] + n) * SLOTS + from]--;
+		counts[(level_offset[l] + n) * SLOTS + to]++;
+		size_t side = (size_t)1 << l;
+		size_t face = n / (side * side);
+		n = face * side * side / 4 + ((n / side) % side / 2) * (side / 2) + (n % side) / 2;
+	}
+}
+
+void sphere_index_t::search(const point3_t &p, const int &slot, const size_t &k, std::vector<std::pair<surface_t *, double>> &found) const
+{
+	const int T = surface_t::TYPE_COUNT;
+	// lower bound on the distance to anything in the cell, level, cell within level
+	typedef std::tuple<double, int, size_t> entry_t;
+	std::priority_queue<entry_t, std::vector<entry_t>, std::greater<entry_t>> open;
+
+	auto push = [&](const int &l, const size_t &n) {
+		const cell_t &c = cells[level_offset[l] + n];
+		if (counts[(level_offset[l] + n) * SLOTS + slot] > 0)
+			open.push({ MAX<double>(0, angle(c.x, c.y, c.z, p) - c.radius), l, n });
+	};
+
+	if (k == 0 || cells.empty())
+		return;
+	for (size_t n = 0; n < 6; n++)
+		push(0, n);
+
+	while (!open.empty()) {
+		entry_t e = open.top();
+		open.pop();
+		if (found.size() == k && std::get<0>(e) > found.front().second)
+			break;
+		int l = std::get<1>(e);
+		size_t n = std::get<2>(e);
+		if (l == depth) {
+			size_t from = bucket[n * T + (slot == T ? 0 : slot)];
+			size_t to = bucket[n * T + (slot == T ? T : slot + 1)];
+			for (size_t m = from; m < to; m++) {
+				surface_t *s = members[m];
+				if (slot != T && s->type != slot)
+					continue;
+				point3_t c = s->get_center_c();
+				double r = std::sqrt(c[0] * c[0] + c[1] * c[1] + c[2] * c[2]);
+				std::pair<surface_t *, double> candidate = { s, angle(c[0] / r, c[1] / r, c[2] / r, p) };
+				if (found.size() < k) {
+					found.push_back(candidate);
+					std::push_heap(found.begin(), found.end(), closer);
+				} else if (closer(candidate, found.front())) {
+					std::pop_heap(found.begin(), found.end(), closer);
+					found.back() = candidate;
+					std::push_heap(found.begin(), found.end(), closer);
+				}
+			}
+		} else {
+			size_t side = (size_t)1 << l;
+			size_t face = n / (side * side);
+			size_t i = (n / side) % side;
+			size_t j = n % side;
+			for (size_t c = 0; c < 4; c++)
+				push(l + 1, face * side * side * 4 + (2 * i + c / 2) * side * 2 + (2 * j + c % 2));
+		}
+	}
+
+	std::sort_heap(found.begin(), found.end(), closer);
+}
+
+std::pair<surface_t *, double> sphere_index_t::nearest(const point3_t &p) const
+{
+	std::vector<std::pair<surface_t *, double>> found;
+	search(p, surface_t::TYPE_COUNT, 1, found);
+	if (found.empty())
+		return { NULL, INFINITY };
+	return found[0];
+}
+
+std::pair<surface_t *, double> sphere_index_t::nearest(const point3_t &p, const surface_t::surface_type &type) const
+{
+	std::vector<std::pair<surface_t *, double>> found;
+	search(p, type, 1, found);
+	if (found.empty())
+		return { NULL, INFINITY };
+	return found[0];
+}
+
+std::vector<std::pair<surface_t *, double>> sphere_index_t::k_nearest(const point3_t &p, const size_t &k) const
+{
+	std::vector<std::pair<surface_t *, double>> found;
+	search(p, surface_t::TYPE_COUNT, k, found);
+	return found;
+}
+
+std::vector<std::pair<surface_t *, double>> sphere_index_t::k_nearest(const point3_t &p, const size_t &k, const surface_t::surface_type &type) const
+{
+	std::vector<std::pair<surface_t *, double>> found;
+	search(p, type, k, found);
+	return found;
+}
+
+std::vector<surface_t *> sphere_index_t::cap(const point3_t &p, const double &theta) const
+{
+	std::vector<surface_t *> found;
+	std::vector<std::pair<int, size_t>> open;
+
+	for (size_t n = 0; n < 6 && !cells.empty(); n++)
+		open.push_back({ 0, n });
+
+	while (!open.empty()) {
+		int l = open.back().first;
+		size_t n = open.back().second;
+		open.pop_back();
+		const cell_t &c = cells[level_offset[l] + n];
+		if (counts[(level_offset[l] + n) * SLOTS + surface_t::TYPE_COUNT] == 0 || angle(c.x, c.y, c.z, p) - c.radius >= theta)
+			continue;
+		if (l == depth) {
+			for (size_t m = bucket[n * surface_t::TYPE_COUNT]; m < bucket[(n + 1) * surface_t::TYPE_COUNT]; m++) {
+				point3_t s = members[m]->get_center_c();
+				double r = std::sqrt(s[0] * s[0] + s[1] * s[1] + s[2] * s[2]);
+				if (angle(s[0] / r, s[1] / r, s[2] / r, p) < theta)
+					found.push_back(members[m]);
+			}
+		} else {
+			size_t side = (size_t)1 << l;
+			size_t face = n / (side * side);
+			size_t i = (n / side) % side;
+			size_t j = n % side;
+			for (size_t c = 0; c < 4; c++)
+				open.push_back({ l + 1, face * side * side * 4 + (2 * i + c / 2) * side * 2 + (2 * j + c % 2) });
+		}
+	}
+
+	// callers walk the cap in face order, same as a scan over the whole world would
+	std::sort(found.begin(), found.end(), [](const surface_t *a, const surface_t *b) { return a->ID < b->ID; });
+	return found;
+}
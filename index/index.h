@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+
+#include "../surface/surface.h"
+#include "../column/column.h"
+
+/*
+ * Hierarchical cube-sphere index over face centers. Every cube face is split
+ * into a quadtree of equal-angle cells down to a leaf level sized to the face
+ * count, and every cell keeps per surface_type member counts so searches never
+ * descend into cells that hold nothing of the requested type.
+ *
+ * Type buckets reflect the face types as of the last sync(); candidates are
+ * checked against their current type, so a query never returns a face of the
+ * wrong type, but faces retyped since the last sync may be missed. A handful
+ * of retyped faces can be moved across instead with retype(), which only
+ * touches the face's leaf bucket and the counts above it.
+ */
+struct sphere_index_t
+{
+private:
+	struct cell_t
+	{
+		double x, y, z;
+		double radius;
+	};
+
+	static constexpr int SLOTS = surface_t::TYPE_COUNT + 1;
+
+	int depth = 0;
+	std::vector<size_t> level_offset;
+	column_vector_t<cell_t> cells;
+	column_vector_t<unsigned int> counts;
+	column_vector_t<unsigned int> leaf_of;
+	column_vector_t<unsigned int> bucket;
+	column_vector_t<surface_t *> members;
+
+	size_t locate(const double &, const double &, const double &, const int &) const;
+	void search(const point3_t &, const int &, const size_t &, std::vector<std::pair<surface_t *, double>> &) const;
+public:
+	void build(const std::vector<surface_t *> &);
+	void sync();
+	void retype(const surface_t *, const surface_t::surface_type &);
+
+	std::pair<surface_t *, double> nearest(const point3_t &) const;
+	std::pair<surface_t *, double> nearest(const point3_t &, const surface_t::surface_type &) const;
+	std::vector<std::pair<surface_t *, double>> k_nearest(const point3_t &, const size_t &) const;
+	std::vector<std::pair<surface_t *, double>> k_nearest(const point3_t &, const size_t &, const surface_t::surface_type &) const;
+	std::vector<surface_t *> cap(const point3_t &, const double &) const;
+};
@@ -0,0 +1,125 @@
+#include "label.h"
+
+#include <atomic>
+#include <memory>
+
+#include "../parallel/parallel.h"
+
+static unsigned int find(std::atomic<unsigned int> *parent, unsigned int x)
+{
+	while (true) {
+		unsigned int p = parent[x].load();
+		if (p == x)
+			return x;
+		unsigned int gp = parent[p].load();
+		if (gp != p)
+			parent[x].compare_exchange_weak(p, gp);
+		x = gp;
+	}
+}
+
+static void unite(std::atomic<unsigned int> *parent, unsigned int a, unsigned int b)
+{
+	while (true) {
+		a = find(parent, a);
+		b = find(parent, b);
+		if (a == b)
+			return;
+		if (a < b)
+			std::swap(a, b);
+		unsigned int expected = a;
+		if (parent[a].compare_exchange_strong(expected, b))
+			return;
+	}
+}
+
+components_t::components_t(const std::vector<surface_t *> &faces, const surface_t::surface_type &type)
+	: label(faces.size(), NONE)
+{
+	std::unique_ptr<std::atomic<unsigned int>[]> parent(new std::atomic<unsigned int>[faces.size()]);
+	column_vector_t<double> area(faces.size(), 0);
+
+	parallel_for(faces.size(), [&](const size_t &from, const size_t &to) {
+		for (size_t i = from; i < to; i++)
+			parent[i].store(i);
+	});
+
+	// every edge is united once, from its lower face
+	parallel_for(faces.size(), [&](const size_t &from, const size_t &to) {
+		for (size_t i = from; i < to; i++) {
+			surface_t *f = faces[i];
+			if (f->type != type)
+				continue;
+			area[i] = f->get_area();
+			for (auto &n : f->neighbors) {
+				if (n->type == type && n->ID > i)
+					unite(parent.get(), i, n->ID);
+			}
+		}
+	});
+
+	column_vector_t<unsigned int> roots(faces.size(), NONE);
+	parallel_for(faces.size(), [&](const size_t &from, const size_t &to) {
+		for (size_t i = from; i < to; i++) {
+			if (faces[i]->type == type)
+				roots[i] = find(parent.get(), i);
+		}
+	});
+	number(faces, roots, area);
+}
+
+components_t::components_t(const std::vector<surface_t *> &faces, const column_vector_t<unsigned int> &roots)
+	: label(faces.size(), NONE)
+{
+	column_vector_t<double> area(faces.size(), 0);
+	parallel_for(faces.size(), [&](const size_t &from, const size_t &to) {
+		for (size_t i = from; i < to; i++) {
+			if (roots[i] != NONE)
+				area[i] = faces[i]->get_area();
+		}
+	});
+	number(faces, roots, area);
+}
+
+void components_t::number(const std::vector<surface_t *> &faces, const column_vector_t<unsigned int> &roots, const column_vector_t<double> &area)
+{
+	for (size_t i = 0; i < faces.size(); i++) {
+		if (roots[i] == i) {
+			label[i] = components.size();
+			components.push_back({ i, 0, 0, point3_t() });
+		}
+	}
+
+	parallel_for(faces.size(), [&](const size_t &from, const size_t &to) {
+		for (size_t i = from; i < to; i++) {
+			if (roots[i] != NONE && label[i] == NONE)
+				label[i] = label[roots[i]];
+		}
+	});
+
+	// summed in face order so the totals do not depend on the thread count
+	std::vector<double> sum(components.size() * 3, 0);
+	for (size_t i = 0; i < faces.size(); i++) {
+		if (label[i] == NONE)
+			continue;
+		component_t &c = components[label[i]];
+		point3_t cc = faces[i]->get_center_c();
+		c.size++;
+		c.area += area[i];
+		for (int k = 0; k < 3; k++)
+			sum[label[i] * 3 + k] += cc[k] * area[i];
+	}
+	for (size_t c = 0; c < components.size(); c++) {
+		double *s = &sum[c * 3];
+		double r = std::sqrt(s[0] * s[0] + s[1] * s[1] + s[2] * s[2]);
+		if (r > 0)
+			components[c].centroid = point3_t(s[0] / r, s[1] / r, s[2] / r);
+	}
+}
+
+const component_t *components_t::operator[](const surface_t *f) const
+{
+	if (label[f->ID] == NONE)
+		return NULL;
+	return &components[label[f->ID]];
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <climits>
+#include <vector>
+
+#include "../surface/surface.h"
+#include "../column/column.h"
+
+struct component_t
+{
+	unsigned long long root;
+	size_t size;
+	double area;
+	point3_t centroid;
+};
+
+/*
+ * Connected regions of faces sharing a surface_type, labeled with a lock-free
+ * union-find over the neighbor graph. Roots always link towards the smaller
+ * face ID, so components come out numbered by their lowest face ID whatever
+ * the thread count. Labels are indexed by surface_t::ID.
+ *
+ * The second constructor takes the lowest face ID of every face's component,
+ * or NONE, as worked out elsewhere, and numbers and sums them the same way.
+ */
+struct components_t
+{
+	static constexpr unsigned int NONE = UINT_MAX;
+
+	column_vector_t<unsigned int> label;
+	std::vector<component_t> components;
+
+	components_t(const std::vector<surface_t *> &, const surface_t::surface_type &);
+	components_t(const std::vector<surface_t *> &, const column_vector_t<unsigned int> &);
+	const component_t *operator[](const surface_t *) const;
+private:
+	void number(const std::vector<surface_t *> &, const column_vector_t<unsigned int> &, const column_vector_t<double> &);
+};
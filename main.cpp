@@ -1,16 +1,169 @@
 #include "engine/engine.h"
+#include "explore/explore.h"
+#include "hierarchy/hierarchy.h"
+#include "parallel/parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+static int bench(const int &seed, const std::string &trace)
+{
+	// the same world on one thread and on all of them, which also checks they agree
+	world_config_t config;
+	config.cache_directory.clear();
+	config.verbose = false;
+	size_t threads = get_thread_count();
+	set_thread_count(1);
+	world_t serial(seed, config);
+	set_thread_count(threads);
+	world_t parallel(seed, config);
+
+	auto one = serial.get_stage_times();
+	auto all = parallel.get_stage_times();
+	std::cout << "stage\t1 thread [ms]\t" << threads << " threads [ms]\tspeedup\n";
+	std::cout << std::fixed << std::setprecision(2);
+	for (size_t s = 0; s < one.size(); s++) {
+		std::cout << one[s].first << "\t" << one[s].second * 1000.0 << "\t" << all[s].second * 1000.0 << "\t"
+			<< (all[s].second > 0 ? one[s].second / all[s].second : 0) << "\n";
+	}
+
+	size_t differing = 0;
+	std::vector<surface_t *> a = serial.get_faces(), b = parallel.get_faces();
+	for (size_t i = 0; i < a.size(); i++) {
+		if (a[i]->type != b[i]->type || a[i]->height != b[i]->height || a[i]->aridity != b[i]->aridity || a[i]->foehn != b[i]->foehn)
+			differing++;
+	}
+	std::cout << "Faces differing: " << differing << "\n";
+
+	if (!trace.empty()) {
+		std::ofstream file(trace);
+		write_trace(file, parallel.get_timeline());
+		std::cout << "Trace written to " << trace << "\n";
+	}
+	return differing == 0 ? 0 : 1;
+}
+
+static int distributed(const int &seed, const int &workers)
+{
+	// the same world in this process and split over worker processes, which have to agree bit for bit
+	world_config_t config;
+	config.cache_directory.clear();
+	config.verbose = false;
+	world_t local(seed, config);
+	config.workers = workers;
+	world_t split(seed, config);
+
+	std::cout << "stage\tpasses\trounds\thalo faces\tbytes\n";
+	for (auto &e : split.get_exchange_stats()) {
+		std::cout << e.first << "\t" << e.second.runs << "\t" << e.second.rounds << "\t" << e.second.halo_faces << "\t"
+			<< e.second.bytes << "\n";
+	}
+
+	size_t differing = 0;
+	std::vector<surface_t *> a = local.get_faces(), b = split.get_faces();
+	for (size_t i = 0; i < a.size(); i++) {
+		bool landmass = (a[i]->landmass == NULL) == (b[i]->landmass == NULL)
+			&& (a[i]->landmass == NULL || a[i]->landmass->members.front()->ID == b[i]->landmass->members.front()->ID);
+		if (a[i]->type != b[i]->type || a[i]->height != b[i]->height || a[i]->aridity != b[i]->aridity || a[i]->foehn != b[i]->foehn || !landmass)
+			differing++;
+	}
+	std::cout << "Faces differing: " << differing << "\n";
+	return differing == 0 ? 0 : 1;
+}
+
+static int hierarchy(const int &seed, const size_t &count)
+{
+	// every level of SEED, and how much of each level's layout its parents already had
+	world_config_t config;
+	config.cache_directory.clear();
+	config.verbose = false;
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	world_hierarchy_t levels(seed, config, count);
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+	std::cout << "level\tface size\tfaces\ttime [ms]\tocean as parent\n";
+	std::cout << std::fixed << std::setprecision(2);
+	for (size_t k = 0; k < levels.get_level_count(); k++) {
+		world_t *level = levels.get_level(k);
+		double seconds = 0;
+		for (auto &s : level->get_stage_times())
+			seconds += s.second;
+		auto ocean = [](const surface_t *f) {
+			return f->type == surface_t::FACE_OCEAN || f->type == surface_t::FACE_DEEP_OCEAN;
+		};
+		size_t agree = 0;
+		std::vector<surface_t *> faces = level->get_faces();
+		for (auto &f : faces) {
+			surface_t *p = levels.get_parent(k, f);
+			agree += p == NULL || ocean(f) == ocean(p);
+		}
+		std::cout << k << "\t" << level->get_config().face_size << "\t" << faces.size() << "\t" << seconds * 1000.0 << "\t"
+			<< 100.0 * agree / MAX<size_t>(1, faces.size()) << "%\n";
+	}
+	std::cout << "Total: " << std::chrono::duration<double>(end - begin).count() * 1000.0 << "[ms]\n";
+	return 0;
+}
 
 int main(int argc, char **argv)
 {
+	// --threads N may come anywhere and is taken out before the rest is read
+	std::vector<std::string> args;
+	for (int i = 1; i < argc; i++) {
+		if (std::string(argv[i]) == "--threads" && i + 1 < argc)
+			set_thread_count(std::stoul(argv[++i]));
+		else
+			args.push_back(argv[i]);
+	}
+
 	engine_t *engine;
-	if (argc != 2) {
+	if ((args.size() == 2 || args.size() == 3) && args[0] == "bench") {
+		// bench SEED [TRACE]: time every stage, and write the parallel run's stage timeline to TRACE
+		return bench(std::stoi(args[1]), args.size() == 3 ? args[2] : "");
+	} else if (args.size() == 3 && args[0] == "distributed") {
+		// distributed SEED WORKERS: build SEED in this process and over WORKERS processes and compare
+		return distributed(std::stoi(args[1]), std::stoi(args[2]));
+	} else if (args.size() == 3 && args[0] == "hierarchy") {
+		// hierarchy SEED LEVELS: build SEED coarse to fine over LEVELS face sizes down to the configured one
+		return hierarchy(std::stoi(args[1]), std::stoul(args[2]));
+	} else if (args.size() >= 3 && args[0] == "explore") {
+		// explore FIRST COUNT [FULL]: rank COUNT seeds from FIRST, rescore the best FULL at full resolution and show the best of those
+		int first = std::stoi(args[1]);
+		int count = std::stoi(args[2]);
+		size_t full = args.size() >= 4 ? std::stoul(args[3]) : 1;
+		std::vector<int> seeds;
+		for (int i = 0; i < count; i++)
+			seeds.push_back(first + i);
+		exploration_t exploration = explore_seeds(seeds, world_config_t());
+		print_scores(std::cout, exploration, 20);
+		if (exploration.scores.empty())
+			return 0;
+
+		// one full world at a time, each using every thread
+		exploration_t rescored;
+		rescored.threads = get_thread_count();
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < MIN<size_t>(MAX<size_t>(full, 1), exploration.scores.size()); i++) {
+			world_t world(exploration.scores[i].seed);
+			rescored.scores.push_back(score_world(exploration.scores[i].seed, world));
+		}
+		rescored.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+		std::stable_sort(rescored.scores.begin(), rescored.scores.end(), [](const seed_score_t &a, const seed_score_t &b) {
+			return a.score > b.score;
+		});
+		std::cout << "\nFull resolution:\n";
+		print_scores(std::cout, rescored, rescored.scores.size());
+		engine = new engine_t(rescored.scores[0].seed);
+	} else if (args.size() != 1) {
 		engine = new engine_t(time(0));
 	} else {
-		engine = new engine_t(std::stoll(argv[1]));
+		engine = new engine_t(std::stoll(args[0]));
 	}
 
 	engine->run();
 	delete engine;
 
 	return 0;
-}
\ No newline at end of file
+}
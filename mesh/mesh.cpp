@@ -0,0 +1,43 @@
+#include "mesh.h"
+
+void mesh_t::build(const column_vector_t<uint32_t> &corners, const size_t &vertices)
+{
+	this->corners = corners;
+
+	// rings by counting sort: count the faces at every vertex, then drop each face into its slots
+	ring_start.assign(vertices + 1, 0);
+	for (auto &v : corners)
+		ring_start[v + 1]++;
+	for (size_t v = 0; v < vertices; v++)
+		ring_start[v + 1] += ring_start[v];
+	ring_faces.resize(corners.size());
+	column_vector_t<uint32_t> fill(ring_start.begin(), ring_start.end() - 1);
+	for (size_t h = 0; h < corners.size(); h++)
+		ring_faces[fill[corners[h]]++] = face(h);
+
+	// the twin of u -> v is v -> u, on one of the few faces around v
+	twins.assign(corners.size(), NONE);
+	for (uint32_t h = 0; h < corners.size(); h++) {
+		if (twins[h] != NONE)
+			continue;
+		const uint32_t u = origin(h), v = target(h);
+		for (const uint32_t *g = ring_begin(v); g != ring_end(v); g++) {
+			if (*g == face(h))
+				continue;
+			for (uint32_t k = 3 * *g; k < 3 * *g + 3; k++) {
+				if (corners[k] == v && target(k) == u) {
+					twins[h] = k;
+					twins[k] = h;
+				}
+			}
+		}
+	}
+}
+
+void mesh_t::clear()
+{
+	corners.clear();
+	twins.clear();
+	ring_start.clear();
+	ring_faces.clear();
+}
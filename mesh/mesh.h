@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "../column/column.h"
+
+/*
+ * Triangle mesh topology over 32-bit face and vertex ids. Face f has the
+ * half-edges 3f, 3f+1 and 3f+2; half-edge h runs from corners[h] to the
+ * next corner of its face, and twin(h) is the half-edge running the other way
+ * on the face across it, or NONE on an open side. The faces around every
+ * vertex form its ring. build() only counts and scans, so it takes linear
+ * time, given vertices shared between faces as a hull's index buffer has them.
+ */
+struct mesh_t
+{
+	static constexpr uint32_t NONE = UINT32_MAX;
+
+	void build(const column_vector_t<uint32_t> &, const size_t &);
+	void clear();
+
+	size_t face_count() const { return corners.size() / 3; }
+	size_t vertex_count() const { return ring_start.empty() ? 0 : ring_start.size() - 1; }
+	const column_vector_t<uint32_t> &get_corners() const { return corners; }
+
+	static uint32_t face(const uint32_t &h) { return h / 3; }
+	static uint32_t next(const uint32_t &h) { return h % 3 == 2 ? h - 2 : h + 1; }
+	uint32_t origin(const uint32_t &h) const { return corners[h]; }
+	uint32_t target(const uint32_t &h) const { return corners[next(h)]; }
+	uint32_t twin(const uint32_t &h) const { return twins[h]; }
+	uint32_t adjacent(const uint32_t &f, const int &k) const { return twins[3 * f + k] == NONE ? NONE : face(twins[3 * f + k]); }
+	const uint32_t *ring_begin(const uint32_t &v) const { return ring_faces.data() + ring_start[v]; }
+	const uint32_t *ring_end(const uint32_t &v) const { return ring_faces.data() + ring_start[v + 1]; }
+
+private:
+	column_vector_t<uint32_t> corners;
+	column_vector_t<uint32_t> twins;
+	column_vector_t<uint32_t> ring_start;
+	column_vector_t<uint32_t> ring_faces;
+};
@@ -0,0 +1,81 @@
+#include "moisture.h"
+
+#include "../parallel/parallel.h"
+#include "../wind/wind.h"
+
+static const double ADVECTION = 1.0;
+static const double DIFFUSION = 0.1;
+static const double PRECIPITATION = 0.5;
+static const double OROGRAPHIC = 0.5;
+
+moisture_t::moisture_t(const std::vector<surface_t *> &faces, const double &tolerance, const int &max_iterations, progress_t *progress)
+	: humidity(faces.size(), 1.0)
+	, precipitation(faces.size(), 0)
+{
+	const size_t N = faces.size();
+
+	// one row of the system per face: humidity = sum(weight * neighbor) / diagonal
+	column_vector_t<unsigned int> first(N + 1, 0);
+	column_vector_t<unsigned int> adjacent;
+	column_vector_t<double> weight;
+	column_vector_t<double> diagonal(N, 1.0);
+	column_vector_t<double> loss(N, 0);
+	for (size_t i = 0; i < N; i++) {
+		surface_t *f = faces[i];
+		if (f->type == surface_t::FACE_LAND) {
+			double total = 0;
+			double rise = 0;
+			double spacing = 0;
+			for (auto &n : f->neighbors) {
+				double w = DIFFUSION;
+				double wf = wind_factor(n->get_center()[1]);
+				if (is_downwind(n, f, wf > 0)) {
+					w += ADVECTION * std::abs(wf);
+					rise = MAX<double>(rise, f->height - n->height);
+				}
+				spacing += std::acos(CLAMP<double>(glm::dot(f->get_center_c().coords, n->get_center_c().coords), -1.0, 1.0)) / f->neighbors.size();
+				adjacent.push_back(n->ID);
+				weight.push_back(w);
+				total += w;
+			}
+			// rain-out per radian travelled plus the share lifted out on the way up
+			loss[i] = PRECIPITATION * spacing + OROGRAPHIC * rise;
+			diagonal[i] = total + loss[i];
+			humidity[i] = 0;
+		}
+		first[i + 1] = adjacent.size();
+	}
+
+	column_vector_t<double> next(humidity);
+	for (iterations = 0; iterations < max_iterations; iterations++) {
+		if (stopped(progress))
+			return;
+		report(progress, (double)iterations / max_iterations);
+		const size_t chunks = MIN<size_t>(N, 64);
+		std::vector<double> change(chunks, 0);
+		parallel_for(chunks, [&](const size_t &from, const size_t &to) {
+			for (size_t c = from; c < to; c++) {
+				for (size_t i = N * c / chunks; i < N * (c + 1) / chunks; i++) {
+					if (first[i] == first[i + 1])
+						continue;
+					double sum = 0;
+					for (unsigned int k = first[i]; k < first[i + 1]; k++)
+						sum += weight[k] * humidity[adjacent[k]];
+					next[i] = sum / diagonal[i];
+					change[c] = MAX<double>(change[c], std::abs(next[i] - humidity[i]));
+				}
+			}
+		});
+		humidity.swap(next);
+		residual = 0;
+		for (auto &c : change)
+			residual = MAX<double>(residual, c);
+		if (residual < tolerance) {
+			iterations++;
+			break;
+		}
+	}
+
+	for (size_t i = 0; i < N; i++)
+		precipitation[i] = humidity[i] * loss[i];
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <vector>
+
+#include "../surface/surface.h"
+#include "../column/column.h"
+#include "../progress/progress.h"
+
+/*
+ * Steady-state humidity carried inland from oceans and lakes. Every land face
+ * takes a weighted mix of its neighbors' humidity, weighted towards upwind
+ * neighbors by the same prevailing wind set_foehn uses, and loses a share to
+ * precipitation that grows on slopes rising from upwind. The resulting sparse
+ * system is solved with parallel Jacobi sweeps until the largest change drops
+ * below the tolerance. Fields are indexed by surface_t::ID.
+ */
+struct moisture_t
+{
+	column_vector_t<double> humidity;
+	column_vector_t<double> precipitation;
+	int iterations = 0;
+	double residual = 0;
+
+	moisture_t(const std::vector<surface_t *> &, const double &, const int &, progress_t * = NULL);
+};
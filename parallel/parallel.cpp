@@ -0,0 +1,223 @@
+#include "parallel.h"
+
+static std::atomic<size_t> requested_threads{ 0 };
+// 0 for threads the pool did not start
+static thread_local size_t worker_index = 0;
+
+void set_thread_count(const size_t &threads)
+{
+	requested_threads = threads;
+}
+
+size_t get_thread_count()
+{
+	size_t threads = requested_threads.load();
+	return threads > 0 ? threads : thread_pool_t::get().size();
+}
+
+thread_pool_t::thread_pool_t(const size_t &threads)
+{
+	for (size_t t = 1; t < threads; t++)
+		workers.emplace_back([this, t]() {
+			worker_index = t;
+			work();
+		});
+}
+
+thread_pool_t::~thread_pool_t()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (auto &w : workers)
+		w.join();
+}
+
+thread_pool_t &thread_pool_t::get()
+{
+	size_t threads = requested_threads.load();
+	if (threads == 0)
+		threads = std::thread::hardware_concurrency() > 0 ? std::thread::hardware_concurrency() : 1;
+	static thread_pool_t pool(threads);
+	return pool;
+}
+
+size_t thread_pool_t::size() const
+{
+	return workers.size() + 1;
+}
+
+void thread_pool_t::help(job_t *job)
+{
+	for (size_t i = job->next++; i < job->count; i = job->next++) {
+		(*job->task)(i);
+		job->done++;
+	}
+}
+
+size_t thread_pool_t::worker()
+{
+	return worker_index;
+}
+
+void thread_pool_t::work()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	while (true) {
+		wake.wait(guard, [&]() { return stopping || !jobs.empty() || !tasks.empty(); });
+		if (stopping)
+			return;
+		// someone is waiting on a loop, nobody is waiting on a task yet
+		if (jobs.empty()) {
+			std::function<void()> task = std::move(tasks.front());
+			tasks.pop_front();
+			guard.unlock();
+			task();
+			guard.lock();
+			continue;
+		}
+		job_t *job = jobs.front();
+		if (job->next.load() >= job->count) {
+			jobs.pop_front();
+			continue;
+		}
+		// the caller keeps the job alive until every helper has let go of it
+		job->helpers++;
+		guard.unlock();
+		help(job);
+		guard.lock();
+		job->helpers--;
+		finished.notify_all();
+	}
+}
+
+void thread_pool_t::run(const size_t &count, const std::function<void(const size_t &)> &task)
+{
+	if (workers.empty()) {
+		for (size_t i = 0; i < count; i++)
+			task(i);
+		return;
+	}
+
+	job_t job;
+	job.task = &task;
+	job.count = count;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		jobs.push_back(&job);
+	}
+	wake.notify_all();
+
+	help(&job);
+
+	std::unique_lock<std::mutex> guard(lock);
+	finished.wait(guard, [&]() { return job.done.load() == job.count && job.helpers == 0; });
+	for (auto it = jobs.begin(); it != jobs.end(); it++) {
+		if (*it == &job) {
+			jobs.erase(it);
+			break;
+		}
+	}
+}
+
+void thread_pool_t::spawn(const std::function<void()> &task)
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		tasks.push_back(task);
+	}
+	wake.notify_one();
+}
+
+bool thread_pool_t::run_task()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	if (tasks.empty())
+		return false;
+	std::function<void()> task = std::move(tasks.front());
+	tasks.pop_front();
+	guard.unlock();
+	task();
+	return true;
+}
+
+size_t task_graph_t::add(const std::string &name, const std::vector<size_t> &after, const std::function<void()> &fn)
+{
+	size_t id = tasks.size();
+	tasks.push_back({ name, fn, {}, after.size() });
+	for (auto &a : after)
+		tasks[a].dependents.push_back(id);
+	return id;
+}
+
+void task_graph_t::launch(const size_t &id)
+{
+	// called with the lock held
+	queued++;
+	thread_pool_t::get().spawn([this, id]() {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			queued--;
+		}
+		double start = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - origin).count();
+		tasks[id].fn();
+		double end = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - origin).count();
+
+		std::lock_guard<std::mutex> guard(lock);
+		timeline.push_back({ tasks[id].name, thread_pool_t::worker(), start, end });
+		for (auto &d : tasks[id].dependents) {
+			if (--tasks[d].waiting == 0)
+				launch(d);
+		}
+		remaining--;
+		changed.notify_all();
+	});
+	changed.notify_all();
+}
+
+void task_graph_t::run()
+{
+	origin = std::chrono::steady_clock::now();
+	timeline.clear();
+	// dependencies come first, so the order tasks were added in is one they may run in
+	if (get_thread_count() <= 1) {
+		for (auto &task : tasks) {
+			double start = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - origin).count();
+			task.fn();
+			double end = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - origin).count();
+			timeline.push_back({ task.name, thread_pool_t::worker(), start, end });
+		}
+		return;
+	}
+
+	std::unique_lock<std::mutex> guard(lock);
+	remaining = tasks.size();
+	for (size_t t = 0; t < tasks.size(); t++) {
+		if (tasks[t].waiting == 0)
+			launch(t);
+	}
+	// without workers every task runs here, with them this thread is one more
+	while (remaining > 0) {
+		if (queued > 0) {
+			guard.unlock();
+			// a worker may have taken it just now, and will say so shortly
+			if (!thread_pool_t::get().run_task())
+				std::this_thread::yield();
+			guard.lock();
+			continue;
+		}
+		changed.wait(guard, [&]() { return remaining == 0 || queued > 0; });
+	}
+}
+
+void write_trace(std::ostream &out, const std::vector<task_span_t> &spans)
+{
+	out << "{\"traceEvents\":[";
+	for (size_t i = 0; i < spans.size(); i++) {
+		out << (i > 0 ? ",\n" : "\n") << "{\"name\":\"" << spans[i].name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << spans[i].thread
+			<< ",\"ts\":" << (long long)spans[i].start << ",\"dur\":" << (long long)(spans[i].end - spans[i].start) << "}";
+	}
+	out << "\n]}\n";
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * One set of worker threads for the whole program, started on first use with
+ * a thread per core unless set_thread_count() said otherwise. run() hands out
+ * task indices to the workers and the calling thread alike and returns once
+ * all of them are done, so any number of threads may call it at once, from
+ * inside a task too: the caller works through its own indices before it
+ * waits, and only waits on threads that are running them. spawn() queues a
+ * task nobody waits on; idle workers take those once no loop needs them, and
+ * run_task() lets a thread with nothing else to do take one itself.
+ */
+struct thread_pool_t
+{
+private:
+	struct job_t
+	{
+		const std::function<void(const size_t &)> *task;
+		size_t count;
+		std::atomic<size_t> next{ 0 };
+		std::atomic<size_t> done{ 0 };
+		size_t helpers = 0;
+	};
+
+	std::vector<std::thread> workers;
+	std::deque<job_t *> jobs;
+	std::deque<std::function<void()>> tasks;
+	std::mutex lock;
+	std::condition_variable wake;
+	std::condition_variable finished;
+	bool stopping = false;
+
+	thread_pool_t(const size_t &);
+	void work();
+	void help(job_t *);
+public:
+	~thread_pool_t();
+	static thread_pool_t &get();
+	size_t size() const;
+	void run(const size_t &, const std::function<void(const size_t &)> &);
+	void spawn(const std::function<void()> &);
+	bool run_task();
+	static size_t worker();
+};
+
+/* when and where a task of a task_graph_t ran, in microseconds from the start of the run */
+struct task_span_t
+{
+	std::string name;
+	size_t thread;
+	double start;
+	double end;
+};
+
+/*
+ * Named tasks that may only start once the tasks they name as dependencies
+ * have finished, which have to be added first. run() spawns every task whose dependencies are done on the pool
+ * and keeps the calling thread busy with pool tasks until all of them have
+ * run, so independent tasks overlap while each can still split its own loops
+ * over every thread; with a thread count of one they run in the order they
+ * were added. The timeline keeps one span per task in finishing order.
+ */
+struct task_graph_t
+{
+private:
+	struct task_t
+	{
+		std::string name;
+		std::function<void()> fn;
+		std::vector<size_t> dependents;
+		size_t waiting = 0;
+	};
+
+	std::vector<task_t> tasks;
+	std::mutex lock;
+	std::condition_variable changed;
+	size_t remaining = 0;
+	size_t queued = 0;
+	std::chrono::steady_clock::time_point origin;
+
+	void launch(const size_t &);
+public:
+	std::vector<task_span_t> timeline;
+
+	size_t add(const std::string &, const std::vector<size_t> &, const std::function<void()> &);
+	void run();
+};
+
+/* the spans as a Chrome trace (chrome://tracing, Perfetto), one row per thread */
+void write_trace(std::ostream &, const std::vector<task_span_t> &);
+
+/*
+ * Threads used by parallel loops, counting the caller; 0 means one per core.
+ * The pool is sized by the count set before the first loop, later counts
+ * only change how finely loops are split.
+ */
+void set_thread_count(const size_t &);
+size_t get_thread_count();
+
+/* splits [0, n) into one contiguous chunk per thread and runs fn(from, to) on the pool */
+template<typename F>
+void parallel_for(const size_t &n, F fn)
+{
+	size_t threads = get_thread_count();
+	if (threads > n)
+		threads = n;
+	if (threads <= 1) {
+		if (n > 0)
+			fn((size_t)0, n);
+		return;
+	}
+
+	thread_pool_t::get().run(threads, [&](const size_t &t) {
+		fn(n * t / threads, n * (t + 1) / threads);
+	});
+}
@@ -0,0 +1,52 @@
+#include "progress.h"
+
+// the stage the calling thread is working on
+struct current_stage_t
+{
+	const progress_t *owner = NULL;
+	std::string stage;
+	size_t index = 0;
+	double last = -1;
+};
+
+static thread_local current_stage_t current;
+
+progress_t::progress_t(const progress_callback_t &callback)
+	: callback(callback)
+{
+}
+
+void progress_t::start(const size_t &count)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	fractions.assign(count, 0);
+}
+
+void progress_t::begin(const std::string &name, const size_t &index)
+{
+	current.owner = this;
+	current.stage = name;
+	current.index = index;
+	current.last = -1;
+	report(0);
+}
+
+void progress_t::report(const double &fraction)
+{
+	if (!callback || current.owner != this || fraction <= current.last || (fraction < 1.0 && fraction - current.last < 0.01))
+		return;
+	current.last = fraction;
+	std::lock_guard<std::mutex> guard(lock);
+	if (current.index >= fractions.size())
+		return;
+	fractions[current.index] = fraction;
+	double total = 0;
+	for (auto &f : fractions)
+		total += f;
+	callback(current.stage, fraction, total / fractions.size());
+}
+
+bool progress_t::stopped() const
+{
+	return cancelled.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/* stage name, fraction of that stage done, fraction of the whole run done */
+typedef std::function<void(const std::string &, const double &, const double &)> progress_callback_t;
+
+/*
+ * Progress and cancellation of one run, shared between the threads doing the
+ * work and whoever waits for it. Long loops poll stopped() and return early
+ * with whatever they have, which the caller then throws away. start() sets
+ * how many stages the run has; stages may then run side by side, each on its
+ * own thread, which begin() ties to the stage so report() knows where its
+ * fraction belongs. The callback runs on the reporting thread, one call at a
+ * time. Reports closer than a percent apart are dropped.
+ */
+struct progress_t
+{
+	progress_callback_t callback;
+	std::atomic<bool> cancelled{ false };
+
+	std::mutex lock;
+	std::vector<double> fractions;
+
+	progress_t(const progress_callback_t & = NULL);
+	void start(const size_t &);
+	void begin(const std::string &, const size_t &);
+	void report(const double &);
+	bool stopped() const;
+};
+
+/* the helpers take the NULL a caller without progress passes in */
+inline bool stopped(const progress_t *progress)
+{
+	return progress != NULL && progress->stopped();
+}
+
+inline void report(progress_t *progress, const double &fraction)
+{
+	if (progress != NULL)
+		progress->report(fraction);
+}
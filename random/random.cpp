@@ -0,0 +1,37 @@
+#include "random.h"
+
+// splitmix64's finalizer, a bijection that scrambles every input bit into every output bit
+static uint64_t mix(uint64_t z)
+{
+	z += 0x9e3779b97f4a7c15ull;
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+random_t::random_t(const uint64_t &seed, const std::string &stream)
+{
+	uint64_t name = 14695981039346656037ull;
+	for (auto &c : stream) {
+		name ^= (unsigned char)c;
+		name *= 1099511628211ull;
+	}
+	key = mix(mix(seed) ^ name);
+}
+
+uint64_t random_t::bits(const uint64_t &id, const uint64_t &counter) const
+{
+	return mix(mix(key ^ mix(id)) + counter);
+}
+
+/* in [0, 1) */
+double random_t::uniform(const uint64_t &id, const uint64_t &counter) const
+{
+	return (bits(id, counter) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* in [0, n) */
+uint64_t random_t::below(const uint64_t &n, const uint64_t &id, const uint64_t &counter) const
+{
+	return bits(id, counter) % n;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+/*
+ * Counter-based random numbers. A generator is keyed by a seed and a stream
+ * name, and every draw is a pure function of that key, an id (usually a face
+ * ID or a loop index) and a counter for several draws under the same id.
+ * Nothing is consumed, so draws may happen in any order, on any thread, be
+ * skipped or be repeated, and still come out the same.
+ */
+struct random_t
+{
+	uint64_t key = 0;
+
+	random_t(const uint64_t & = 0, const std::string & = "");
+	uint64_t bits(const uint64_t &, const uint64_t & = 0) const;
+	double uniform(const uint64_t &, const uint64_t & = 0) const;
+	uint64_t below(const uint64_t &, const uint64_t &, const uint64_t & = 0) const;
+};
@@ -0,0 +1,130 @@
+#include "sealevel.h"
+
+#include <algorithm>
+
+#include "../field/field.h"
+
+static bool is_sea(const surface_t *f)
+{
+	return f->type == surface_t::FACE_WATER || f->type == surface_t::FACE_OCEAN || f->type == surface_t::FACE_DEEP_OCEAN;
+}
+
+static unsigned int find(column_vector_t<unsigned int> &parent, unsigned int x)
+{
+	while (parent[x] != x) {
+		parent[x] = parent[parent[x]];
+		x = parent[x];
+	}
+	return x;
+}
+
+// great-circle length of the side two neighboring faces have in common
+static double shared_side(const surface_t *f, const surface_t *n)
+{
+	const polar_t fv[3] = { f->a, f->b, f->c };
+	const polar_t nv[3] = { n->a, n->b, n->c };
+	point3_t ends[2];
+	int found = 0;
+	for (int i = 0; i < 3 && found < 2; i++) {
+		for (int j = 0; j < 3; j++) {
+			if (fv[i] == nv[j]) {
+				ends[found++] = point3_t(fv[i], 1.0);
+				break;
+			}
+		}
+	}
+	if (found < 2)
+		return 0;
+	return std::acos(CLAMP<double>(glm::dot(ends[0].coords, ends[1].coords), -1.0, 1.0));
+}
+
+sea_level_sweep_t::sea_level_sweep_t(const std::vector<surface_t *> &faces)
+	: elevation(faces.size(), 0)
+	, order(faces.size())
+{
+	distance_field_t land_field(faces, surface_t::FACE_LAND);
+	for (auto &f : faces) {
+		if (!is_sea(f))
+			elevation[f->ID] = f->height;
+		else if (land_field[f].first != NULL)
+			elevation[f->ID] = -land_field[f].second;
+		else
+			elevation[f->ID] = -M_PI;
+	}
+
+	for (size_t i = 0; i < faces.size(); i++)
+		order[i] = i;
+	std::sort(order.begin(), order.end(), [&](const unsigned int &a, const unsigned int &b) {
+		return elevation[a] > elevation[b] || (elevation[a] == elevation[b] && a < b);
+	});
+}
+
+std::vector<sea_level_t> sea_level_sweep_t::sweep(const std::vector<surface_t *> &faces, const std::vector<double> &levels) const
+{
+	std::vector<sea_level_t> result(levels.size());
+	std::vector<size_t> pending(levels.size());
+	for (size_t i = 0; i < levels.size(); i++)
+		pending[i] = i;
+	std::sort(pending.begin(), pending.end(), [&](const size_t &a, const size_t &b) {
+		return levels[a] > levels[b];
+	});
+
+	double total = 0;
+	column_vector_t<double> area(faces.size(), 0);
+	for (auto &f : faces) {
+		area[f->ID] = f->get_area();
+		total += area[f->ID];
+	}
+
+	column_vector_t<unsigned int> parent(faces.size());
+	std::vector<bool> raised(faces.size(), false);
+	double land = 0;
+	double coastline = 0;
+	double largest = 0;
+	size_t count = 0;
+
+	size_t next = 0;
+	for (auto &l : pending) {
+		for (; next < order.size() && elevation[order[next]] >= levels[l]; next++) {
+			unsigned int i = order[next];
+			surface_t *f = faces[i];
+			raised[i] = true;
+			parent[i] = i;
+			land += area[i];
+			count++;
+			for (auto &n : f->neighbors) {
+				// a side to a raised neighbor stops being coast, any other side becomes coast
+				double side = shared_side(f, n);
+				if (!raised[n->ID]) {
+					coastline += side;
+					continue;
+				}
+				coastline -= side;
+				unsigned int a = find(parent, i);
+				unsigned int b = find(parent, n->ID);
+				if (a == b)
+					continue;
+				if (a > b)
+					std::swap(a, b);
+				parent[b] = a;
+				area[a] += area[b];
+				count--;
+			}
+			largest = MAX<double>(largest, area[find(parent, i)]);
+		}
+		result[l] = { levels[l], total > 0 ? land / total : 0, count, largest, MAX<double>(0.0, coastline) };
+	}
+	return result;
+}
+
+void sea_level_sweep_t::apply(const std::vector<surface_t *> &faces, const double &level) const
+{
+	for (auto &f : faces) {
+		if (elevation[f->ID] >= level) {
+			if (is_sea(f))
+				f->type = surface_t::FACE_LAND;
+		} else if (f->type != surface_t::FACE_OCEAN && f->type != surface_t::FACE_DEEP_OCEAN) {
+			f->type = surface_t::FACE_OCEAN;
+		}
+	}
+}
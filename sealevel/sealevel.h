@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vector>
+
+#include "../surface/surface.h"
+#include "../column/column.h"
+
+struct sea_level_t
+{
+	double level;
+	double land_fraction;
+	size_t landmass_count;
+	double largest_landmass;
+	double coastline;
+};
+
+/*
+ * Land/water statistics over many sea levels from a single pass. Faces are
+ * sorted once by elevation, highest first, and raised out of the water one at
+ * a time into an incremental union-find, so every requested level is read off
+ * as the sweep passes it. Land keeps its height as elevation; water faces take
+ * the negated distance to the nearest land as a stand-in for depth, so level 0
+ * reproduces the generated coastline. Areas are in steradians and coastline
+ * lengths in radians. Elevations are indexed by surface_t::ID.
+ */
+struct sea_level_sweep_t
+{
+	column_vector_t<double> elevation;
+	column_vector_t<unsigned int> order;
+
+	sea_level_sweep_t(const std::vector<surface_t *> &);
+	std::vector<sea_level_t> sweep(const std::vector<surface_t *> &, const std::vector<double> &) const;
+	void apply(const std::vector<surface_t *> &, const double &) const;
+};
@@ -0,0 +1,48 @@
+#include "stage.h"
+
+size_t stage_graph_t::add(const std::string &name, const unsigned int &version, const std::vector<size_t> &inputs, const unsigned int &params, const unsigned int &outputs, const std::function<void(const random_t &)> &run)
+{
+	stages.push_back({ name, version, inputs, params, outputs, run, NULL, NULL });
+	return stages.size() - 1;
+}
+
+std::vector<bool> stage_graph_t::dirty(const unsigned int &changed) const
+{
+	std::vector<bool> marked(stages.size(), false);
+	for (size_t s = 0; s < stages.size(); s++) {
+		marked[s] = (stages[s].params & changed) != 0;
+		for (auto &i : stages[s].inputs)
+			marked[s] = marked[s] || marked[i];
+	}
+	return marked;
+}
+
+std::vector<bool> stage_graph_t::all() const
+{
+	return std::vector<bool>(stages.size(), true);
+}
+
+size_t stage_graph_t::producer(const size_t &stage, const unsigned int &column, const std::vector<bool> &dirty) const
+{
+	// the last clean stage before `stage` that wrote the column holds its value as `stage` should see it
+	for (size_t s = stage; s-- > 0;) {
+		if (!dirty[s] && (stages[s].outputs & column) != 0)
+			return s;
+	}
+	return NONE;
+}
+
+std::vector<uint64_t> stage_graph_t::keys(const std::function<void(hasher_t &, const unsigned int &)> &params) const
+{
+	std::vector<uint64_t> key(stages.size());
+	for (size_t s = 0; s < stages.size(); s++) {
+		hasher_t h;
+		h.add(stages[s].name);
+		h.add(stages[s].version);
+		params(h, stages[s].params);
+		for (auto &i : stages[s].inputs)
+			h.add(key[i]);
+		key[s] = h.value;
+	}
+	return key;
+}
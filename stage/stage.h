@@ -0,0 +1,49 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "../cache/cache.h"
+#include "../random/random.h"
+
+/*
+ * One step of a pipeline: the stages it reads from, the bitmask of parameters
+ * it reads and the bitmask of data columns it writes. A stage that sets save
+ * and load can be kept on disk; load returns false if the blob does not fit.
+ * run draws its random numbers from the generator it is handed, so stages
+ * that run at the same time never share one.
+ * Bump the version whenever the stage computes something different.
+ */
+struct stage_t
+{
+	std::string name;
+	unsigned int version;
+	std::vector<size_t> inputs;
+	unsigned int params;
+	unsigned int outputs;
+	std::function<void(const random_t &)> run;
+	std::function<void(blob_t &)> save;
+	std::function<bool(blob_t &)> load;
+};
+
+/*
+ * Stages in the order they were added, which has to be a topological order:
+ * a stage may only name stages added before it as inputs. Changing a set of
+ * parameters dirties every stage that reads one of them and everything
+ * downstream of those. A stage's key hashes its name, version and the
+ * parameters it reads (through the callback) together with the keys of its
+ * inputs, so it changes whenever anything upstream of the stage does.
+ */
+struct stage_graph_t
+{
+	std::vector<stage_t> stages;
+
+	size_t add(const std::string &, const unsigned int &, const std::vector<size_t> &, const unsigned int &, const unsigned int &, const std::function<void(const random_t &)> &);
+	std::vector<bool> dirty(const unsigned int &) const;
+	std::vector<bool> all() const;
+	size_t producer(const size_t &, const unsigned int &, const std::vector<bool> &) const;
+	std::vector<uint64_t> keys(const std::function<void(hasher_t &, const unsigned int &)> &) const;
+
+	static constexpr size_t NONE = (size_t)-1;
+};
@@ -1,6 +1,8 @@
 #include "surface.h"
 #include <algorithm>
 
+#include "../traverse/traverse.h"
+
 surface_t::surface_t(const unsigned long long &ID, const polar_t &a, const polar_t &b, const polar_t &c)
 	: ID{ ID }
 	, a{ a }
@@ -20,6 +22,20 @@ const point3_t surface_t::get_center_c() const
 	return this->c_center;
 }
 
+const double surface_t::get_area() const
+{
+	// solid angle of the spherical triangle (Van Oosterom & Strackee)
+	point3_t pa(a, 1.0);
+	point3_t pb(b, 1.0);
+	point3_t pc(c, 1.0);
+	double triple =
+		pa[0] * (pb[1] * pc[2] - pb[2] * pc[1]) +
+		pa[1] * (pb[2] * pc[0] - pb[0] * pc[2]) +
+		pa[2] * (pb[0] * pc[1] - pb[1] * pc[0]);
+	double d = 1.0 + glm::dot(pa.coords, pb.coords) + glm::dot(pb.coords, pc.coords) + glm::dot(pc.coords, pa.coords);
+	return 2.0 * std::abs(std::atan2(triple, d));
+}
+
 const bool surface_t::operator==(const surface_t &f)
 {
 	return f.a == a && f.b == b && f.c == c;
@@ -121,15 +137,12 @@ bool surface_t::borders_ocean() const
 	return false;
 }
 
-bool surface_t::sees_ocean(const double &basin_height, std::vector<const surface_t *> &explored) const
+bool surface_t::sees_ocean(const double &basin_height, traversal_t &traversal) const
 {
-	if (this->type == surface_t::FACE_OCEAN)
-		return true;
-
-	explored.push_back(this);
-	for (auto &n : this->neighbors) {
-		if (std::find(explored.begin(), explored.end(), n) == explored.end() && n->height <= basin_height && n->sees_ocean(basin_height, explored))
-			return true;
-	}
-	return false;
+	traversal.begin();
+	return !traversal.bfs(
+		std::vector<const surface_t *>{ this },
+		[&](const surface_t *, const surface_t *n) { return n->height <= basin_height; },
+		[](const surface_t *f) { return f->type != surface_t::FACE_OCEAN; }
+	);
 }
\ No newline at end of file
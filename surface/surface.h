@@ -8,6 +8,31 @@
 
 struct surface_t;
 struct landmass_t;
+struct traversal_t;
+
+/*
+ * The faces across a triangle's sides, kept inline instead of in a vector of
+ * their own. A triangle has at most three; push_back drops any beyond that.
+ */
+struct neighbors_t
+{
+	void push_back(surface_t *n)
+	{
+		if (count < 3)
+			slots[count++] = n;
+	}
+
+	void clear() { count = 0; }
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	surface_t *operator[](const size_t &i) const { return slots[i]; }
+	surface_t *const *begin() const { return slots; }
+	surface_t *const *end() const { return slots + count; }
+
+private:
+	surface_t *slots[3] = { NULL, NULL, NULL };
+	unsigned char count = 0;
+};
 
 struct surface_t
 {
@@ -28,11 +53,13 @@ struct surface_t
 		FACE_DEEP_OCEAN
 	} type = FACE_WATER;
 
+	static constexpr int TYPE_COUNT = FACE_DEEP_OCEAN + 1;
+
 	double height = 0;
 	double aridity = 0;
 	double foehn = 0;
 
-	std::vector<surface_t *> neighbors;
+	neighbors_t neighbors;
 
 	landmass_t *landmass = NULL;
 
@@ -41,13 +68,14 @@ struct surface_t
 	const bool operator<(const surface_t &);
 	const polar_t get_center() const;
 	const point3_t get_center_c() const;
+	const double get_area() const;
 	const biome_t get_biome() const;
 
 	const bool does_share_side(const surface_t *) const;
 	std::vector<surface_t *> get_highest_neighbors() const;
 	std::vector<surface_t *> get_lowest_neighbors() const;
 	bool borders_ocean() const;
-	bool sees_ocean(const double &, std::vector<const surface_t *> &) const;
+	bool sees_ocean(const double &, traversal_t &) const;
 
 private:
 	polar_t s_center;
@@ -59,6 +87,8 @@ struct landmass_t
 {
 	double r, g, b;
 	std::vector<surface_t *> members;
+	double area = 0;
+	point3_t centroid;
 };
 
 inline double true_dist(const surface_t *a, const surface_t *b)
@@ -0,0 +1,30 @@
+#include "traverse.h"
+
+#include <algorithm>
+
+void traversal_t::resize(const size_t &size)
+{
+	marks.assign(size, 0);
+	epoch = 0;
+}
+
+void traversal_t::begin()
+{
+	if (++epoch == 0) {
+		std::fill(marks.begin(), marks.end(), 0);
+		epoch = 1;
+	}
+}
+
+bool traversal_t::visit(const surface_t *f)
+{
+	if (marks[f->ID] == epoch)
+		return false;
+	marks[f->ID] = epoch;
+	return true;
+}
+
+bool traversal_t::visited(const surface_t *f) const
+{
+	return marks[f->ID] == epoch;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+
+#include "../surface/surface.h"
+#include "../column/column.h"
+
+/*
+ * Iterative traversals over the neighbor graph. Visited faces are stamped with
+ * the current epoch, so begin() starts a new traversal in O(1) without clearing
+ * the marks; searches run until the next begin() share their visited faces.
+ * Marks are indexed by surface_t::ID.
+ *
+ * `follow(from, to)` decides whether an unvisited neighbor is entered, and the
+ * visit callbacks return false to end the traversal early.
+ */
+struct traversal_t
+{
+private:
+	column_vector_t<unsigned int> marks;
+	unsigned int epoch = 0;
+public:
+	void resize(const size_t &);
+	void begin();
+	bool visit(const surface_t *);
+	bool visited(const surface_t *) const;
+
+	/* breadth-first from every root, memory bounded by the frontier */
+	template<typename Face, typename Follow, typename Visit>
+	bool bfs(const std::vector<Face *> &roots, Follow follow, Visit visit)
+	{
+		std::deque<Face *> open;
+		for (auto &r : roots) {
+			if (this->visit(r))
+				open.push_back(r);
+		}
+		while (!open.empty()) {
+			Face *curr = open.front();
+			open.pop_front();
+			if (!visit(curr))
+				return false;
+			for (auto &n : curr->neighbors) {
+				if (!visited(n) && follow(curr, n)) {
+					this->visit(n);
+					open.push_back(n);
+				}
+			}
+		}
+		return true;
+	}
+
+	/*
+	 * depth-first from a single root in the same order a recursion over neighbors would take,
+	 * `enter` runs before and `leave` after a face's subtree; children are only expanded
+	 * while the remaining depth is not zero, a negative depth never runs out
+	 */
+	template<typename Face, typename Follow, typename Enter, typename Leave>
+	bool dfs(Face *root, const int &depth, Follow follow, Enter enter, Leave leave)
+	{
+		struct frame_t
+		{
+			Face *face;
+			int depth;
+			size_t next;
+		};
+		std::vector<frame_t> open;
+
+		if (visited(root))
+			return true;
+		visit(root);
+		if (!enter(root))
+			return false;
+		open.push_back({ root, depth, 0 });
+		while (!open.empty()) {
+			frame_t &top = open.back();
+			if (top.depth == 0 || top.next == top.face->neighbors.size()) {
+				leave(top.face);
+				open.pop_back();
+				continue;
+			}
+			Face *curr = top.face;
+			Face *n = curr->neighbors[top.next++];
+			if (visited(n) || !follow(curr, n))
+				continue;
+			visit(n);
+			if (!enter(n))
+				return false;
+			open.push_back({ n, top.depth < 0 ? top.depth : top.depth - 1, 0 });
+		}
+		return true;
+	}
+};
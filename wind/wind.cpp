@@ -0,0 +1,299 @@
+#include "wind.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <unordered_map>
+
+#include "../parallel/parallel.h"
+
+double wind_factor(const double &y)
+{
+	return CLAMP<double>(std::pow(DSIN(3.0 * (y - 90.0)), 2) / DCOS(3.0 * (y - 90.0)), -1, 1) / 2.0;
+}
+
+bool is_downwind(const surface_t *f, const surface_t *n, const bool &east)
+{
+	double d = n->get_center()[0] - f->get_center()[0];
+	if (std::abs(d) > 10)
+		d = -d;
+	return east ? d > 0 : d < 0;
+}
+
+static double falloff(const double &lat, const double &start_y)
+{
+	return MAX<double>(0, -std::sqrt(std::abs(lat - start_y) / 10.0) + 1.0);
+}
+
+int foehn_band_count(const double &band_size)
+{
+	return (int)std::ceil(180.0 / band_size) + 1;
+}
+
+int foehn_band(const surface_t *f, const double &band_size)
+{
+	return CLAMP<int>(f->get_center()[1] / band_size, 0, foehn_band_count(band_size) - 1);
+}
+
+int foehn_reach(const double &band_size)
+{
+	// falloff() is zero 10 degrees from where a stream started
+	return (int)std::ceil(10.0 / band_size);
+}
+
+void foehn_t::build(const std::vector<surface_t *> &faces, const double &band_size)
+{
+	band_count = foehn_band_count(band_size);
+	reach = foehn_reach(band_size);
+	band_of.assign(faces.size(), 0);
+	std::vector<size_t> sizes(band_count, 0);
+	for (auto &f : faces) {
+		band_of[f->ID] = foehn_band(f, band_size);
+		sizes[band_of[f->ID]]++;
+	}
+	bands.assign(band_count, {});
+	for (int b = 0; b < band_count; b++)
+		bands[b].reserve(sizes[b]);
+	for (auto &f : faces)
+		bands[band_of[f->ID]].push_back(f);
+	parts.assign(band_count, {});
+	swept.reset(new std::atomic<unsigned char>[band_count]);
+	for (int b = 0; b < band_count; b++)
+		swept[b].store(0);
+}
+
+namespace
+{
+	/* one source's stream on a face: which way it blows, its strength and the latitude it started at */
+	struct stream_t
+	{
+		uint32_t source;
+		bool east;
+		double p;
+		double y;
+	};
+}
+
+void foehn_t::sweep(const int &b)
+{
+	// streams stay within the bands in reach of b
+	const int first = MAX<int>(0, b - reach), last = MIN<int>(band_count - 1, b + reach);
+	auto inside = [&](const surface_t *f) {
+		return band_of[f->ID] >= first && band_of[f->ID] <= last;
+	};
+
+	// only faces a stream can get to are swept: downhill from a source, never into a lake, as many steps as the strongest can last
+	std::vector<surface_t *> reached;
+	std::unordered_map<uint32_t, uint32_t> seen;
+	double strongest = 0;
+	for (auto &f : bands[b]) {
+		if (f->type != surface_t::FACE_LAND)
+			continue;
+		strongest = MAX<double>(strongest, std::abs(wind_factor(f->get_center()[1]) * std::pow(f->height, 1.25)));
+		seen[f->ID] = 0;
+		reached.push_back(f);
+	}
+	for (size_t from = 0, steps = 0; from < reached.size() && steps * 0.025 <= strongest; steps++) {
+		const size_t to = reached.size();
+		for (size_t k = from; k < to; k++) {
+			for (auto &n : reached[k]->neighbors) {
+				if (!inside(n) || n->height >= reached[k]->height || n->type == surface_t::FACE_INLAND_LAKE
+					|| !seen.emplace(n->ID, 0).second)
+					continue;
+				reached.push_back(n);
+			}
+		}
+		from = to;
+	}
+	std::sort(reached.begin(), reached.end(), [](const surface_t *x, const surface_t *y) {
+		return x->height > y->height || (x->height == y->height && x->ID < y->ID);
+	});
+
+	// seen now holds where a reached face keeps its streams
+	for (uint32_t k = 0; k < reached.size(); k++)
+		seen[reached[k]->ID] = k;
+	std::vector<std::vector<stream_t>> streams(reached.size());
+	std::vector<foehn_part_t> left;
+	for (uint32_t k = 0; k < reached.size(); k++) {
+		surface_t *n = reached[k];
+		const double y = n->get_center()[1];
+		std::vector<stream_t> &here = streams[k];
+		if (n->type != surface_t::FACE_INLAND_LAKE) {
+			for (auto &u : n->neighbors) {
+				if (u->height <= n->height)
+					continue;
+				auto j = seen.find(u->ID);
+				if (j == seen.end())
+					continue;
+				for (auto &s : streams[j->second]) {
+					if (s.p - 0.025 < 0 || !is_downwind(u, n, s.east))
+						continue;
+					double p = (s.p - 0.025) * falloff(y, s.y);
+					if (p > 0)
+						here.push_back({ s.source, s.east, p, s.y });
+				}
+			}
+		}
+		if (band_of[n->ID] == b && n->type == surface_t::FACE_LAND) {
+			double p_factor = wind_factor(y) * std::pow(n->height, 1.25);
+			if (p_factor != 0)
+				here.push_back({ static_cast<uint32_t>(n->ID), p_factor > 0, std::abs(p_factor), y });
+		}
+
+		// a source reaching a face along several paths counts once, along its strongest
+		std::sort(here.begin(), here.end(), [](const stream_t &x, const stream_t &y) {
+			return x.source < y.source || (x.source == y.source && x.p > y.p);
+		});
+		here.erase(std::unique(here.begin(), here.end(), [](const stream_t &x, const stream_t &y) {
+			return x.source == y.source;
+		}), here.end());
+		double sum = 0;
+		for (auto &s : here)
+			sum += s.p;
+		if (sum != 0)
+			left.push_back({ static_cast<uint32_t>(b), static_cast<uint32_t>(n->ID), sum });
+	}
+	std::sort(left.begin(), left.end(), [](const foehn_part_t &x, const foehn_part_t &y) {
+		return x.face < y.face;
+	});
+	parts[b].swap(left);
+}
+
+double foehn_t::total(const surface_t *f) const
+{
+	double sum = 0;
+	const int b = band_of[f->ID];
+	for (int s = MAX<int>(0, b - reach); s <= MIN<int>(band_count - 1, b + reach); s++) {
+		auto p = std::lower_bound(parts[s].begin(), parts[s].end(), f->ID, [](const foehn_part_t &x, const unsigned long long &face) {
+			return x.face < face;
+		});
+		if (p != parts[s].end() && p->face == f->ID)
+			sum += p->value;
+	}
+	return sum;
+}
+
+bool foehn_t::sweep(const std::vector<int> &sweeps, progress_t *progress)
+{
+	// sweeps keep their streams to themselves and write their own slot of every face, so any of them may run at once
+	const size_t slices = MIN<size_t>(8, sweeps.size());
+	for (size_t slice = 0; slice < slices; slice++) {
+		const size_t from = sweeps.size() * slice / slices, to = sweeps.size() * (slice + 1) / slices;
+		parallel_for(to - from, [&](const size_t &a, const size_t &z) {
+			for (size_t k = from + a; k < from + z && !stopped(progress); k++)
+				sweep(sweeps[k]);
+		});
+		if (stopped(progress))
+			return false;
+		report(progress, (slice + 1.0) / slices);
+	}
+	for (auto &b : sweeps)
+		swept[b].store(2);
+	return true;
+}
+
+void foehn_t::advect(const std::vector<surface_t *> &faces, progress_t *progress)
+{
+	std::vector<int> sweeps(band_count);
+	for (int b = 0; b < band_count; b++)
+		sweeps[b] = b;
+	if (!sweep(sweeps, progress))
+		return;
+	collect(faces);
+}
+
+void foehn_t::collect(const std::vector<surface_t *> &faces)
+{
+	// band by band, which adds up every face's parts in the order total() does
+	for (auto &f : faces)
+		f->foehn = 0;
+	for (int b = 0; b < band_count; b++) {
+		for (auto &p : parts[b])
+			faces[p.face]->foehn += p.value;
+	}
+}
+
+std::vector<surface_t *> foehn_t::update(const std::vector<surface_t *> &changed)
+{
+	// a face is seen by the sweeps of the bands within reach of it, which write as far out again
+	std::vector<bool> rerun(band_count, false);
+	for (auto &f : changed) {
+		for (int b = MAX<int>(0, band_of[f->ID] - reach); b <= MIN<int>(band_count - 1, band_of[f->ID] + reach); b++)
+			rerun[b] = true;
+	}
+	std::vector<int> sweeps;
+	std::vector<bool> summed(band_count, false);
+	for (int b = 0; b < band_count; b++) {
+		if (!rerun[b])
+			continue;
+		sweeps.push_back(b);
+		for (int i = MAX<int>(0, b - reach); i <= MIN<int>(band_count - 1, b + reach); i++)
+			summed[i] = true;
+	}
+	sweep(sweeps);
+
+	std::vector<surface_t *> touched;
+	for (int b = 0; b < band_count; b++) {
+		if (!summed[b])
+			continue;
+		for (auto &f : bands[b]) {
+			f->foehn = total(f);
+			touched.push_back(f);
+		}
+	}
+	return touched;
+}
+
+double foehn_t::evaluate(const surface_t *f)
+{
+	const int b = band_of[f->ID];
+	for (int s = MAX<int>(0, b - reach); s <= MIN<int>(band_count - 1, b + reach); s++) {
+		// 0 not swept, 1 claimed by a thread sweeping it, 2 done; other bands sweep meanwhile
+		unsigned char expected = 0;
+		if (swept[s].compare_exchange_strong(expected, 1)) {
+			sweep(s);
+			swept[s].store(2, std::memory_order_release);
+			continue;
+		}
+		while (swept[s].load(std::memory_order_acquire) != 2)
+			std::this_thread::yield();
+	}
+	return total(f);
+}
+
+size_t foehn_t::swept_bands() const
+{
+	size_t count = 0;
+	if (!swept)
+		return 0;
+	for (int b = 0; b < band_count; b++)
+		count += swept[b].load() == 2;
+	return count;
+}
+
+std::vector<foehn_part_t> foehn_t::get_parts() const
+{
+	std::vector<foehn_part_t> all;
+	for (auto &band : parts)
+		all.insert(all.end(), band.begin(), band.end());
+	return all;
+}
+
+bool foehn_t::restore(const std::vector<foehn_part_t> &all)
+{
+	std::vector<std::vector<foehn_part_t>> restored(band_count);
+	for (auto &p : all) {
+		if (p.band >= (uint32_t)band_count || p.face >= band_of.size() || std::abs((int)p.band - band_of[p.face]) > reach)
+			return false;
+		restored[p.band].push_back(p);
+	}
+	for (auto &band : restored) {
+		std::sort(band.begin(), band.end(), [](const foehn_part_t &x, const foehn_part_t &y) {
+			return x.face < y.face;
+		});
+	}
+	parts.swap(restored);
+	for (int b = 0; b < band_count; b++)
+		swept[b].store(2);
+	return true;
+}
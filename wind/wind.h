@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "../surface/surface.h"
+#include "../column/column.h"
+#include "../progress/progress.h"
+
+/* what the sweep of one band left on one face; faces it did not reach have none */
+struct foehn_part_t
+{
+	uint32_t band;
+	uint32_t face;
+	double value;
+};
+
+/*
+ * Foehn advection in latitude bands. Every land face pushes its wind term
+ * downwind (east or west depending on its latitude) onto strictly lower
+ * neighbors, losing 0.025 per step and falling off with the distance from the
+ * latitude it started at. A face's foehn sums the streams of every source
+ * reaching it; a source reaching it along several paths counts once, along
+ * the strongest of them.
+ *
+ * The sources of each band are swept once from the highest face of the band
+ * and those within reach of it down, which is a topological order for the
+ * strictly descending wind paths. The reach covers the 10 degrees of latitude
+ * past which falloff leaves nothing of a stream. Streams only live while
+ * their sweep runs and every sweep keeps its own parts, so all bands run in
+ * parallel.
+ *
+ * Every sweep keeps what it left on each face it reached, so update() only
+ * reruns the sweeps that can see a changed face and returns the faces whose
+ * foehn was summed again. evaluate() instead runs the missing sweeps around a
+ * single face on demand and is safe to call from many threads; it returns
+ * the face's foehn without storing it. The parts can be taken out and
+ * restored after build(), which counts every band as swept; sweep() runs
+ * only the given bands and collect() sums what there is, so the parts can
+ * also be put together from sweeps done elsewhere. A cancelled progress
+ * makes advect() return between bands with nothing summed.
+ */
+struct foehn_t
+{
+private:
+	int band_count = 0;
+	int reach = 0;
+	column_vector_t<int> band_of;
+	std::vector<column_vector_t<surface_t *>> bands;
+	std::vector<std::vector<foehn_part_t>> parts;	// by band, in face order
+	std::unique_ptr<std::atomic<unsigned char>[]> swept;
+
+	void sweep(const int &);
+	double total(const surface_t *) const;
+public:
+	void build(const std::vector<surface_t *> &, const double &);
+	void advect(const std::vector<surface_t *> &, progress_t * = NULL);
+	bool sweep(const std::vector<int> &, progress_t * = NULL);
+	void collect(const std::vector<surface_t *> &);
+	std::vector<surface_t *> update(const std::vector<surface_t *> &);
+	double evaluate(const surface_t *);
+	size_t swept_bands() const;
+	std::vector<foehn_part_t> get_parts() const;
+	bool restore(const std::vector<foehn_part_t> &);
+};
+
+/* the latitude bands foehn_t sweeps for a band size, the band of a face and how many bands a stream crosses */
+int foehn_band_count(const double &);
+int foehn_band(const surface_t *, const double &);
+int foehn_reach(const double &);
+
+/* prevailing wind at a latitude, positive blowing east */
+double wind_factor(const double &);
+bool is_downwind(const surface_t *, const surface_t *, const bool &);
@@ -2,275 +2,662 @@
 
 #include <glm/glm.hpp>
 #include <algorithm>
+#include <array>
 #include <chrono>
 #include <map>
-
+#include <sstream>
+#include <thread>
+
+#include "../erosion/erosion.h"
+#include "../field/field.h"
+#include "../hydrology/hydrology.h"
+#include "../label/label.h"
+#include "../moisture/moisture.h"
+#include "../parallel/parallel.h"
+#include "../wind/wind.h"
+#include "../delaunay/delaunay.h"
 #include "../quickhull/QuickHull.hpp"
 #include "../SimplexNoise/SimplexNoise.h"
 
-void world_t::iterate_land(surface_t *curr, int w)
+void world_t::iterate_land(const std::vector<surface_t *> &roots, const int &w)
 {
-	if (curr->type == surface_t::FACE_LAND)
-		return;
-	curr->type = surface_t::FACE_LAND;
-	if (w > 0) {
-		for (auto &n : curr->neighbors) {
-			if (n->type == surface_t::FACE_WATER || n->type == surface_t::FACE_OCEAN || n->type == surface_t::FACE_DEEP_OCEAN)
-				iterate_land(n, w - 1);
-		}
+	// each face turns to land the first time it is reached and is never expanded again,
+	// so overlapping roots do not regrow the same region
+	traversal.begin();
+	for (auto &root : roots) {
+		if (root->type == surface_t::FACE_LAND)
+			continue;
+		traversal.dfs(
+			root,
+			MAX<int>(0, w),
+			[](const surface_t *, const surface_t *n) {
+				return n->type == surface_t::FACE_WATER || n->type == surface_t::FACE_OCEAN || n->type == surface_t::FACE_DEEP_OCEAN;
+			},
+			[](surface_t *f) {
+				f->type = surface_t::FACE_LAND;
+				return true;
+			},
+			[](surface_t *) {}
+		);
 	}
 }
 
-std::vector<surface_t *> world_t::get_water_extent(surface_t *f)
+// the stage running on this thread, which partitioned passes count their traffic under
+static thread_local const std::string *current_stage = NULL;
+
+static std::string stage_name()
+{
+	return current_stage != NULL ? *current_stage : "edit";
+}
+
+static double aridity_noise_at(const int &noise_offset, const surface_t *f)
+{
+	point3_t cc = f->get_center_c();
+	double pm =
+		SimplexNoise::noise(noise_offset + cc[0] + 100, cc[1], cc[2]) * 0.5 +
+		SimplexNoise::noise(noise_offset + cc[0] * 2.0 + 100, cc[1] * 2.0, cc[2] * 2.0) * 0.25 +
+		SimplexNoise::noise(noise_offset + cc[0] * 4.0 + 100, cc[1] * 4.0, cc[2] * 4.0) * 0.15 +
+		SimplexNoise::noise(noise_offset + cc[0] * 8.0 + 100, cc[1] * 8.0, cc[2] * 8.0) * 0.1;
+	return pm / 2.0;
+}
+
+static double lake_dryness(const double &distance)
+{
+	return std::pow(distance, 0.6) * 2.0;
+}
+
+column_vector_t<double> world_t::get_dryness()
 {
-	std::vector<surface_t *> closed;
-	std::vector<surface_t *> open = { f };
+	column_scope_t scope(&columns);
+	column_vector_t<double> dryness(faces.size(), 0);
+	if (config.moisture_transport) {
+		moisture_t moisture(faces, config.moisture_tolerance, config.moisture_iterations, progress);
+		if (stopped(progress))
+			return dryness;
+		out() << "Moisture Solver: " << moisture.iterations << " iterations, residual " << moisture.residual << "\n";
+		for (auto &f : faces)
+			dryness[f->ID] = (1.0 - moisture.humidity[f->ID]);
+	} else {
+		if (lake_field == NULL) {
+			// a field cut short by a cancel is not kept for later queries
+			distance_field_t field = build_field(surface_t::FACE_INLAND_LAKE);
+			if (stopped(progress))
+				return dryness;
+			lake_field = new distance_field_t(std::move(field));
+		}
+		for (auto &f : faces)
+			dryness[f->ID] = lake_dryness(lake_field->distance[f->ID]);
+	}
+	return dryness;
+}
 
-	while (!open.empty()) {
-		surface_t *curr = open.back();
-		open.erase(std::remove(open.begin(), open.end(), curr), open.end());
-		closed.push_back(curr);
-		for (auto &n : curr->neighbors) {
-			if (n->type == surface_t::FACE_WATER
-				&& std::find(closed.begin(), closed.end(), n) == closed.end()
-				&& std::find(open.begin(), open.end(), n) == open.end())
-				open.push_back(n);
+const column_vector_t<double> &world_t::get_moisture_dryness()
+{
+	// the solver is global, so the first lazy query runs it for everyone
+	if (!moisture_ready.load(std::memory_order_acquire)) {
+		std::lock_guard<std::mutex> guard(moisture_lock);
+		if (!moisture_ready.load(std::memory_order_relaxed)) {
+			moisture_dryness = get_dryness();
+			moisture_ready.store(true, std::memory_order_release);
 		}
 	}
+	return moisture_dryness;
+}
+
+template<typename Compute>
+static void memoize(std::atomic<unsigned char> &state, std::atomic<size_t> &count, Compute compute)
+{
+	// 0 not evaluated, 1 claimed by a thread computing it, 2 done
+	unsigned char expected = 0;
+	if (state.compare_exchange_strong(expected, 1)) {
+		compute();
+		count++;
+		state.store(2, std::memory_order_release);
+		return;
+	}
+	while (state.load(std::memory_order_acquire) != 2)
+		std::this_thread::yield();
+}
+
+double world_t::get_aridity(surface_t *f)
+{
+	if (!lazy)
+		return f->aridity;
+	memoize(aridity_state[f->ID], aridity_count, [&]() {
+		if (f->type != surface_t::FACE_LAND)
+			return;
+		double dryness;
+		if (config.moisture_transport) {
+			dryness = get_moisture_dryness()[f->ID];
+		} else {
+			dryness = lake_dryness(walk_nearest(f, surface_t::FACE_INLAND_LAKE).second);
+		}
+		f->aridity = MAX<double>(0.0, dryness + aridity_noise[f->ID]) * config.aridity_multiplier;
+	});
+	return f->aridity;
+}
+
+double world_t::get_foehn(surface_t *f)
+{
+	if (!lazy)
+		return f->foehn;
+	memoize(foehn_state[f->ID], foehn_count, [&]() {
+		f->foehn = foehn.evaluate(f);
+	});
+	return f->foehn;
+}
 
-	return closed;
+biome_t world_t::get_biome(surface_t *f)
+{
+	get_aridity(f);
+	get_foehn(f);
+	return f->get_biome();
+}
+
+evaluation_stats_t world_t::get_evaluation_stats() const
+{
+	if (!lazy)
+		return { faces.size(), faces.size(), faces.size(), foehn.swept_bands() };
+	return { faces.size(), aridity_count.load(), foehn_count.load(), foehn.swept_bands() };
+}
+
+void world_t::evaluate_all()
+{
+	// not safe against getters running at the same time, edits call it before touching anything
+	if (!lazy)
+		return;
+	column_scope_t scope(&columns);
+	column_vector_t<double> dryness;
+	if (config.moisture_transport) {
+		dryness = get_moisture_dryness();
+	} else {
+		dryness = get_dryness();
+	}
+	parallel_for(faces.size(), [&](const size_t &from, const size_t &to) {
+		for (size_t i = from; i < to; i++) {
+			surface_t *f = faces[i];
+			if (f->type == surface_t::FACE_LAND && aridity_state[f->ID].load() != 2)
+				f->aridity = MAX<double>(0.0, dryness[f->ID] + aridity_noise[f->ID]) * config.aridity_multiplier;
+		}
+	});
+	foehn.advect(faces);
+	lazy = false;
 }
 
 std::pair<surface_t *, double> world_t::find_nearest(surface_t *f, const surface_t::surface_type &type)
 {
 	if (f->type == type)
 		return { f, 0 };
+	return index.nearest(f->get_center_c(), type);
+}
 
-	std::vector<section_t> curr = { sections[(size_t)(f->get_center()[0] / 10.0)][(size_t)(f->get_center()[1] / 10.0)] };
-	std::vector<section_t> explored;
-
-	bool check_flag = false;
-	surface_t *min = NULL;
-	double d = INFINITY;
-
-	while (!curr.empty()) {
-		for (auto &sub : curr) {
-			for (auto &s : sub.members) {
-				if (s->type != type)
-					continue;
-				double t = true_dist(f, s);
-				if (min == NULL || t < d) {
-					d = t;
-					min = s;
-				}
-			}
-			explored.push_back(sub);
-		}
-		if (min != NULL && check_flag)
-			return { min, d };
-		else if (min != NULL)
-			check_flag = true;
-		curr = expand(curr, explored);
+void world_t::set_foehn()
+{
+	std::chrono::steady_clock::time_point begin, end;
+	if (config.lazy_fields) {
+		out() << "Deferring Foehn Map...\n";
+		begin = std::chrono::steady_clock::now();
+		foehn.build(faces, config.face_size);
+		foehn_state.reset(new std::atomic<unsigned char>[faces.size()]);
+		for (size_t i = 0; i < faces.size(); i++)
+			foehn_state[i].store(0);
+		foehn_count = 0;
+	} else {
+		out() << "Setting Foehn Map...\n";
+		begin = std::chrono::steady_clock::now();
+		foehn.build(faces, config.face_size);
+		if (cluster.enabled())
+			cluster.advect(foehn, faces, stage_name());
+		else
+			foehn.advect(faces, progress);
 	}
-	return { min, d };
+	end = std::chrono::steady_clock::now();
+	out() << "Elapsed: "
+		<< std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()
+		<< "[us]" << std::endl;
 }
 
-void world_t::stagnate_lake(const double &basin_height, surface_t *curr)
+void world_t::set_landmasses()
 {
-	curr->type = surface_t::FACE_STAGNANT;
-	for (auto &n : curr->neighbors) {
-		if (n->height <= basin_height && n->type == surface_t::FACE_LAND)
-			stagnate_lake(basin_height, n);
+	for (auto &f : faces)
+		f->landmass = NULL;
+	for (auto &e : landmasses)
+		delete e;
+	landmasses.clear();
+
+	components_t land = build_components(surface_t::FACE_LAND);
+	for (auto &c : land.components) {
+		landmass_t *l = landmass_color(c.root);
+		l->area = c.area;
+		l->centroid = c.centroid;
+		l->members.reserve(c.size);
+		landmasses.push_back(l);
+	}
+	for (auto &s : faces) {
+		if (land.label[s->ID] == components_t::NONE)
+			continue;
+		s->landmass = landmasses[land.label[s->ID]];
+		s->landmass->members.push_back(s);
 	}
 }
 
-std::vector<surface_t *> world_t::get_lake_edges(surface_t *curr, std::vector<const surface_t *> &explored)
+std::vector<sea_level_t> world_t::sweep_sea_levels(const std::vector<double> &levels)
 {
-	explored.push_back(curr);
-	std::vector<surface_t *> edges;
-	bool flag = false;
-	for (auto &n : curr->neighbors) {
-		if (n->type == surface_t::FACE_LAND) {
-			flag = true;
-		} else if (std::find(explored.begin(), explored.end(), n) == explored.end() && n->type == surface_t::FACE_STAGNANT) {
-			auto ex2 = get_lake_edges(n, explored);
-			for (auto &e : ex2)
-				edges.push_back(e);
-		}
-	}
-	if (flag)
-		edges.push_back(curr);
-	return edges;
+	column_scope_t scope(&columns);
+	// elevations are taken once from the generated world, so later set_sea_level calls do not move them
+	if (sea_levels == NULL)
+		sea_levels = new sea_level_sweep_t(faces);
+	return sea_levels->sweep(faces, levels);
 }
 
-bool world_t::iterate_rivers()
+void world_t::set_sea_level(const double &level)
 {
-	std::vector<surface_t *> rivers;
-	for (auto &f : faces) {
-		if (f->type == surface_t::FACE_FLOWING)
-			rivers.push_back(f);
-	}
+	if (sea_levels == NULL)
+		sea_levels = new sea_level_sweep_t(faces);
+	sea_levels->apply(faces, level);
+	set_landmasses();
+	index.sync();
+
+	// the sea level moved the coast under the edit state, let the next edit rebuild it
+	terrain.clear();
+	delete lake_field;
+	lake_field = NULL;
+}
 
-	if (rivers.empty())
-		return false;
+static surface_t::surface_type terrain_type(const surface_t::surface_type &type)
+{
+	switch (type) {
+		case surface_t::FACE_LAND:
+			return surface_t::FACE_LAND;
+		case surface_t::FACE_FLOWING:
+		case surface_t::FACE_STAGNANT:
+		case surface_t::FACE_INLAND_LAKE:
+			return surface_t::FACE_FLOWING;
+		default:
+			return surface_t::FACE_OCEAN;
+	}
+}
 
-	for (auto &s : rivers) {
-		if (s->borders_ocean()) {
-			s->type = surface_t::FACE_INLAND_LAKE;
+void world_t::prepare_edits()
+{
+	column_scope_t scope(&columns);
+	// without the generator's springs every wet face acts as one, which carves the same rivers and lakes again
+	if (terrain.empty()) {
+		terrain.resize(faces.size());
+		for (auto &f : faces)
+			terrain[f->ID] = terrain_type(f->type);
+		foehn.build(faces, config.face_size);
+		foehn.advect(faces);
+	}
+	if (aridity_noise.empty()) {
+		aridity_noise.assign(faces.size(), 0);
+		if (noise_offset >= 0) {
+			for (auto &f : faces)
+				aridity_noise[f->ID] = aridity_noise_at(noise_offset, f);
 		} else {
-			auto lv = s->get_lowest_neighbors();
-			if (!lv.empty()) {
-				surface_t *ln = NULL;
-				for (auto &e : lv) {
-					if (ln == NULL || find_nearest(e, surface_t::FACE_OCEAN).second < find_nearest(ln, surface_t::FACE_OCEAN).second)
-						ln = e;
-				}
-				std::vector<const surface_t *> ex;
-				s->type = surface_t::FACE_INLAND_LAKE;
-				if (!ln->sees_ocean(ln->height, ex)) {
-					ex.clear();
-					stagnate_lake(ln->height, ln);
-					std::vector<surface_t *> possible = get_lake_edges(ln, ex);
-					for (auto &e : possible) {
-						auto hv = e->get_highest_neighbors();
-						if (!hv.empty()) {
-							surface_t *hn = NULL;
-							for (auto &e : hv) {
-								if (hn == NULL || find_nearest(e, surface_t::FACE_OCEAN).second > find_nearest(hn, surface_t::FACE_OCEAN).second)
-									hn = e;
-							}
-							hn->type = surface_t::FACE_FLOWING;
-						}
-					}
-				} else if (ln->height <= s->height) {
-					ln->type = surface_t::FACE_FLOWING;
-				} else {
-					s->type = surface_t::FACE_INLAND_LAKE;
-				}
-			} else {
-				s->type = surface_t::FACE_INLAND_LAKE;
+			// loaded worlds only keep the sum, so the noise is whatever the dryness does not explain
+			column_vector_t<double> dryness = get_dryness();
+			for (auto &f : faces) {
+				if (f->type == surface_t::FACE_LAND)
+					aridity_noise[f->ID] = f->aridity / config.aridity_multiplier - dryness[f->ID];
 			}
 		}
 	}
-	return true;
+	if (!config.moisture_transport && lake_field == NULL)
+		lake_field = new distance_field_t(faces, surface_t::FACE_INLAND_LAKE);
 }
 
-void world_t::propagate_wind_east(surface_t *f, double p_factor, const double &start_y, std::vector<const surface_t *> &explored)
+std::vector<surface_t *> world_t::relabel_landmasses(const std::vector<surface_t *> &changed)
 {
-	explored.push_back(f);
-	f->foehn += p_factor;
-	p_factor -= 0.025;
-	if (p_factor < 0)
-		return;
-	for (auto &n : f->neighbors) {
-		if (
-			((n->get_center()[0] > f->get_center()[0] && std::abs(n->get_center()[0] - f->get_center()[0]) <= 10) || (n->get_center()[0] < f->get_center()[0] && std::abs(n->get_center()[0] - f->get_center()[0]) > 10))
-			&& n->height < f->height && n->type != surface_t::FACE_INLAND_LAKE && std::find(explored.begin(), explored.end(), n) == explored.end()
-			) {
-			propagate_wind_east(
-				n,
-				p_factor * MAX<double>(0, -std::sqrt(std::abs(n->get_center()[1] - start_y) / 10.0) + 1.0),
-				start_y,
-				explored
-			);
+	// every landmass a changed face belonged to or borders may have grown, shrunk, joined or split
+	std::vector<landmass_t *> stale;
+	std::vector<surface_t *> seeds;
+	for (auto &f : changed) {
+		seeds.push_back(f);
+		if (f->landmass != NULL)
+			stale.push_back(f->landmass);
+		for (auto &n : f->neighbors) {
+			if (n->landmass != NULL)
+				stale.push_back(n->landmass);
+		}
+	}
+	std::sort(stale.begin(), stale.end());
+	stale.erase(std::unique(stale.begin(), stale.end()), stale.end());
+	for (auto &l : stale)
+		seeds.insert(seeds.end(), l->members.begin(), l->members.end());
+	std::sort(seeds.begin(), seeds.end(), [](const surface_t *a, const surface_t *b) {
+		return a->ID < b->ID;
+	});
+
+	std::vector<std::vector<surface_t *>> parts;
+	traversal.begin();
+	for (auto &f : seeds) {
+		if (f->type != surface_t::FACE_LAND || traversal.visited(f))
+			continue;
+		parts.push_back({});
+		traversal.bfs(
+			std::vector<surface_t *>{ f },
+			[](const surface_t *, const surface_t *n) {
+				return n->type == surface_t::FACE_LAND;
+			},
+			[&](surface_t *m) {
+				parts.back().push_back(m);
+				return true;
+			}
+		);
+	}
+
+	// a new landmass keeps the color of the old one it took most faces from, unless another took it first
+	std::vector<landmass_t *> created;
+	std::vector<landmass_t *> claimed;
+	for (auto &members : parts) {
+		std::map<landmass_t *, size_t> votes;
+		for (auto &m : members) {
+			if (m->landmass != NULL)
+				votes[m->landmass]++;
+		}
+		landmass_t *from = NULL;
+		for (auto &v : votes) {
+			if (std::find(claimed.begin(), claimed.end(), v.first) == claimed.end() && (from == NULL || v.second > votes[from]))
+				from = v.first;
+		}
+		std::sort(members.begin(), members.end(), [](const surface_t *a, const surface_t *b) {
+			return a->ID < b->ID;
+		});
+		landmass_t *l;
+		if (from != NULL) {
+			claimed.push_back(from);
+			l = new landmass_t{ from->r, from->g, from->b };
+		} else {
+			l = landmass_color(members.front()->ID);
+		}
+		double sum[3] = { 0, 0, 0 };
+		for (auto &m : members) {
+			double area = m->get_area();
+			point3_t cc = m->get_center_c();
+			l->area += area;
+			for (int k = 0; k < 3; k++)
+				sum[k] += cc[k] * area;
+		}
+		double r = std::sqrt(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+		if (r > 0)
+			l->centroid = point3_t(sum[0] / r, sum[1] / r, sum[2] / r);
+		l->members = members;
+		created.push_back(l);
+	}
+
+	std::vector<surface_t *> relabeled;
+	for (auto &l : stale) {
+		for (auto &m : l->members) {
+			m->landmass = NULL;
+			relabeled.push_back(m);
+		}
+	}
+	for (auto &l : created) {
+		for (auto &m : l->members) {
+			m->landmass = l;
+			relabeled.push_back(m);
 		}
 	}
+	landmasses.erase(std::remove_if(landmasses.begin(), landmasses.end(), [&](landmass_t *l) {
+		return std::binary_search(stale.begin(), stale.end(), l);
+	}), landmasses.end());
+	for (auto &l : stale)
+		delete l;
+	landmasses.insert(landmasses.end(), created.begin(), created.end());
+	return relabeled;
 }
 
-void world_t::propagate_wind_west(surface_t *f, double p_factor, const double &start_y, std::vector<const surface_t *> &explored)
+surface_t::surface_type world_t::get_terrain(surface_t *f)
 {
-	explored.push_back(f);
-	f->foehn += p_factor;
-	p_factor -= 0.025;
-	if (p_factor < 0)
-		return;
-	for (auto &n : f->neighbors) {
-		if (
-			((n->get_center()[0] < f->get_center()[0] && std::abs(n->get_center()[0] - f->get_center()[0]) <= 10) || (n->get_center()[0] > f->get_center()[0] && std::abs(n->get_center()[0] - f->get_center()[0]) > 10))
-			&& n->height < f->height && n->type != surface_t::FACE_INLAND_LAKE && std::find(explored.begin(), explored.end(), n) == explored.end()
-			) {
-			propagate_wind_west(
-				n,
-				p_factor * MAX<double>(0, -std::sqrt(std::abs(n->get_center()[1] - start_y) / 10.0) + 1.0),
-				start_y,
-				explored
-			);
+	evaluate_all();
+	prepare_edits();
+	return terrain[f->ID];
+}
+
+size_t world_t::edit(const std::vector<terrain_edit_t> &edits)
+{
+	column_scope_t scope(&columns);
+	evaluate_all();
+	prepare_edits();
+
+	std::vector<surface_t *> moved;
+	std::vector<surface_t *> seeds;
+	for (auto &e : edits) {
+		if (e.face->height != e.height)
+			moved.push_back(e.face);
+		e.face->height = e.height;
+		terrain[e.face->ID] = terrain_type(e.type);
+		seeds.push_back(e.face);
+		seeds.insert(seeds.end(), e.face->neighbors.begin(), e.face->neighbors.end());
+	}
+
+	// drainage never crosses the ocean, so the region is every landmass an edit touches plus its coast
+	std::vector<surface_t *> region;
+	traversal.begin();
+	for (auto &f : seeds) {
+		if (terrain[f->ID] == surface_t::FACE_OCEAN) {
+			if (traversal.visit(f))
+				region.push_back(f);
+			continue;
 		}
+		if (traversal.visited(f))
+			continue;
+		traversal.bfs(
+			std::vector<surface_t *>{ f },
+			[&](const surface_t *, const surface_t *n) {
+				return terrain[n->ID] != surface_t::FACE_OCEAN;
+			},
+			[&](surface_t *m) {
+				region.push_back(m);
+				return true;
+			}
+		);
+	}
+	const size_t inland = region.size();
+	for (size_t i = 0; i < inland; i++) {
+		for (auto &n : region[i]->neighbors) {
+			if (terrain[n->ID] == surface_t::FACE_OCEAN && traversal.visit(n))
+				region.push_back(n);
+		}
+	}
+
+	std::vector<surface_t::surface_type> before(region.size());
+	for (size_t i = 0; i < region.size(); i++) {
+		before[i] = region[i]->type;
+		region[i]->type = terrain[region[i]->ID];
+	}
+	hydrology_t hydrology(faces, region);
+	hydrology.carve(region, traversal);
+	for (auto &f : region) {
+		if (f->type == surface_t::FACE_STAGNANT)
+			f->type = surface_t::FACE_INLAND_LAKE;
+	}
+
+	// landmasses only change where a face turned to or from land
+	std::vector<surface_t *> changed(moved);
+	std::vector<surface_t *> coast;
+	for (size_t i = 0; i < region.size(); i++) {
+		if (region[i]->type == before[i])
+			continue;
+		index.retype(region[i], before[i]);
+		if (std::find(moved.begin(), moved.end(), region[i]) == moved.end())
+			changed.push_back(region[i]);
+		if ((region[i]->type == surface_t::FACE_LAND) != (before[i] == surface_t::FACE_LAND))
+			coast.push_back(region[i]);
 	}
+	if (changed.empty())
+		return 0;
+
+	std::vector<surface_t *> touched(changed);
+	std::vector<surface_t *> arid(changed);
+	if (config.moisture_transport) {
+		// the moisture solve is global, so every face is re-read from it
+		column_vector_t<double> dryness = get_dryness();
+		for (auto &f : faces)
+			f->aridity = f->type == surface_t::FACE_LAND ? MAX<double>(0.0, dryness[f->ID] + aridity_noise[f->ID]) * config.aridity_multiplier : 0;
+		touched = faces;
+	} else {
+		std::vector<surface_t *> refilled = lake_field->repair(faces, changed);
+		arid.insert(arid.end(), refilled.begin(), refilled.end());
+		for (auto &f : arid)
+			f->aridity = f->type == surface_t::FACE_LAND ? MAX<double>(0.0, lake_dryness(lake_field->distance[f->ID]) + aridity_noise[f->ID]) * config.aridity_multiplier : 0;
+		touched.insert(touched.end(), refilled.begin(), refilled.end());
+	}
+
+	std::vector<surface_t *> swept = foehn.update(changed);
+	touched.insert(touched.end(), swept.begin(), swept.end());
+	if (!coast.empty()) {
+		std::vector<surface_t *> relabeled = relabel_landmasses(coast);
+		touched.insert(touched.end(), relabeled.begin(), relabeled.end());
+	}
+
+	// sea level elevations are taken from the terrain, so the next sweep starts over
+	delete sea_levels;
+	sea_levels = NULL;
+
+	std::sort(touched.begin(), touched.end(), [](const surface_t *a, const surface_t *b) {
+		return a->ID < b->ID;
+	});
+	return std::unique(touched.begin(), touched.end()) - touched.begin();
 }
 
-void world_t::set_foehn()
+void world_t::clear_mesh()
+{
+	// a new mesh invalidates everything kept about the old one
+	faces.clear();
+	column_vector_t<surface_t>().swap(surfaces);
+	topology.clear();
+	parents.clear();
+	for (auto &e : landmasses)
+		delete e;
+	landmasses.clear();
+	delete sea_levels;
+	sea_levels = NULL;
+	delete lake_field;
+	lake_field = NULL;
+	terrain.clear();
+	aridity_noise.clear();
+	height_noise.clear();
+	deep_roots.clear();
+}
+
+void world_t::save_mesh(blob_t &blob)
 {
+	column_vector_t<float> corners;
+	column_vector_t<uint32_t> degree;
+	column_vector_t<uint32_t> neighbors;
+	corners.reserve(faces.size() * 6);
+	degree.reserve(faces.size());
 	for (auto &f : faces) {
-		if (f->type == surface_t::FACE_LAND) {
-			double w_factor = CLAMP<double>(std::pow(DSIN(3.0 * (f->get_center()[1] - 90.0)), 2) / DCOS(3.0 * (f->get_center()[1] - 90.0)), -1, 1) / 2.0;
-			double h_factor = std::pow(f->height, 1.25) * 1.0;
-			double p_factor = w_factor * h_factor;
-			std::vector<const surface_t *> explored;
-			if (p_factor > 0) {
-				propagate_wind_east(f, p_factor, f->get_center()[1], explored);
-			} else {
-				propagate_wind_west(f, -p_factor, f->get_center()[1], explored);
-			}
+		for (const polar_t *p : { &f->a, &f->b, &f->c }) {
+			corners.push_back((*p)[0]);
+			corners.push_back((*p)[1]);
 		}
+		degree.push_back(f->neighbors.size());
+		for (auto &n : f->neighbors)
+			neighbors.push_back(n->ID);
 	}
+	blob.put(corners);
+	blob.put(degree);
+	blob.put(neighbors);
+	blob.put(topology.get_corners());
+	blob.put<uint64_t>(topology.vertex_count());
 }
 
-void world_t::make_landmasses(surface_t *curr)
+bool world_t::load_mesh(blob_t &blob)
 {
-	for (auto &n : curr->neighbors) {
-		if (n->type != surface_t::FACE_LAND || n->landmass != NULL)
-			continue;
-		n->landmass = curr->landmass;
-		make_landmasses(n);
+	// neighbors are kept as they were ordered, the float corners may no longer tell
+	column_vector_t<float> corners;
+	column_vector_t<uint32_t> degree;
+	column_vector_t<uint32_t> neighbors;
+	column_vector_t<uint32_t> vertices;
+	uint64_t vertex_count;
+	if (!blob.get(corners) || !blob.get(degree) || !blob.get(neighbors) || !blob.get(vertices) || !blob.get(vertex_count)
+		|| corners.size() != degree.size() * 6 || vertices.size() != degree.size() * 3)
+		return false;
+	size_t total = 0;
+	for (auto &d : degree) {
+		if (d > 3)
+			return false;
+		total += d;
+	}
+	if (total != neighbors.size())
+		return false;
+	for (auto &n : neighbors) {
+		if (n >= degree.size())
+			return false;
+	}
+	for (auto &v : vertices) {
+		if (v >= vertex_count)
+			return false;
+	}
+
+	clear_mesh();
+	surfaces.reserve(degree.size());
+	faces.reserve(degree.size());
+	for (size_t i = 0; i < degree.size(); i++) {
+		const float *c = &corners[i * 6];
+		surfaces.emplace_back(i, polar_t(c[0], c[1]), polar_t(c[2], c[3]), polar_t(c[4], c[5]));
+		faces.push_back(&surfaces.back());
+	}
+	size_t next = 0;
+	for (auto &f : faces) {
+		for (uint32_t k = 0; k < degree[f->ID]; k++)
+			f->neighbors.push_back(faces[neighbors[next++]]);
 	}
+	topology.build(vertices, vertex_count);
+	index.build(faces);
+	traversal.resize(faces.size());
+	return true;
 }
 
-const std::vector<section_t> world_t::expand(const std::vector<section_t> &input, const std::vector<section_t> &explored)
+/*
+ * Fills every face's neighbors from the topology. A face lists the faces
+ * across its sides ordered by the side's corners, lower corner first, which
+ * is the order generation has always seen them in.
+ */
+void world_t::set_neighbors()
 {
-	std::vector<section_t> output;
-	for (auto &s : input) {
-		for (int j = -1; j <= 1; j++) {
-			int lat = MAX<int>(0, MIN<int>(17, s.lat + j));
-			int sc = MAX<int>(0, MIN<int>(18, scale(lat * 10)));
-			for (int i = -sc; i <= sc; i++) {
-				if (i == 0 && j == 0)
-					continue;
-				int lon = (s.lon + i + 36) % 36;
-				if (std::find(output.begin(), output.end(), sections[lon][lat]) == output.end()
-					&& std::find(explored.begin(), explored.end(), sections[lon][lat]) == explored.end())
-					output.push_back(sections[lon][lat]);
-			}
+	for (auto &f : faces) {
+		const polar_t *p[3] = { &f->a, &f->b, &f->c };
+		std::pair<polar_t, polar_t> sides[3];
+		int order[3] = { 0, 1, 2 };
+		for (int k = 0; k < 3; k++) {
+			const polar_t &u = *p[k], &v = *p[(k + 1) % 3];
+			sides[k] = u < v ? std::make_pair(u, v) : std::make_pair(v, u);
+		}
+		std::sort(order, order + 3, [&](const int &l, const int &r) { return sides[l] < sides[r]; });
+		f->neighbors.clear();
+		for (auto &k : order) {
+			uint32_t n = topology.adjacent(f->ID, k);
+			if (n != mesh_t::NONE)
+				f->neighbors.push_back(faces[n]);
 		}
 	}
-
-	return output;
 }
 
-
-const bool section_t::operator==(const section_t &s) const
+// the polar coordinates of a point in space, the way the mesh has always translated its vertices
+static polar_t to_polar(const double &x, const double &y, const double &z)
 {
-	return lon == s.lon && lat == s.lat;
+	double r = std::sqrt(x * x + y * y + z * z);
+	return polar_t(180.0 * std::atan2(y, x) / M_PI + 180.0, 180.0 * std::asin(z / r) / M_PI + 90.0);
 }
 
-world_t::world_t(const int &SEED)
+void world_t::build_hull(const random_t &rng, column_vector_t<polar_t> &vertices, column_vector_t<uint32_t> &corners)
 {
-	for (int i = 0; i < 36; i++) {
-		for (int j = 0; j < 18; j++) {
-			sections[i][j].lon = i;
-			sections[i][j].lat = j;
-		}
-	}
+	out() << "Sampling points...\n";
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
 
-	int noise_offset = rand();
 	std::vector<polar_t> ps;
 
-	double size = (double)FACE_SIZE;
+	double size = config.face_size;
 
-	for (int i = size; i <= 180 - size; i += size) {
-		for (double j = size; j < 360;) {
-			double x = j + ((double)rand() / (double)RAND_MAX) * (size / 2.0);
-			double y = (double)i + ((double)rand() / (double)RAND_MAX) * (size / 2.0);
+	size_t point = 0;
+	for (double i = size; i <= 180 - size; i += size) {
+		for (double j = size; j < 360; point++) {
+			double x = j + rng.uniform(point, 0) * (size / 2.0);
+			double y = i + rng.uniform(point, 1) * (size / 2.0);
 			ps.push_back(polar_t(x, y));
 			j += scale(i) * size;
 		}
@@ -279,8 +666,8 @@ world_t::world_t(const int &SEED)
 	ps.push_back(polar_t(0, 0));
 	ps.push_back(polar_t(0, 180));
 
-	quickhull::QuickHull<double> qh;
 	std::vector<quickhull::Vector3<double>> qhpoints;
+	qhpoints.reserve(ps.size());
 
 	for (auto &p : ps) {
 		point3_t c(p, 1);
@@ -290,149 +677,420 @@ world_t::world_t(const int &SEED)
 			c[2]
 			});
 	}
+	// swapping with an empty vector frees the memory, clear() would keep it
+	std::vector<polar_t>().swap(ps);
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	out() << "Elapsed: "
+		<< std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()
+		<< "[us]" << std::endl;
+
+	if (config.mesh_source == world_config_t::MESH_PARALLEL_HULL) {
+		out() << "Triangulating points...\n";
+		begin = std::chrono::steady_clock::now();
+		std::vector<glm::dvec3> points(qhpoints.size());
+		for (size_t i = 0; i < qhpoints.size(); i++)
+			points[i] = glm::dvec3(qhpoints[i].x, qhpoints[i].y, qhpoints[i].z);
+		bool built = triangulate_sphere(points, size * M_PI / 180, corners);
+		if (built) {
+			vertices.reserve(points.size());
+			for (auto &p : points)
+				vertices.push_back(to_polar(p.x, p.y, p.z));
+		}
+		end = std::chrono::steady_clock::now();
+		out() << "Elapsed: "
+			<< std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()
+			<< "[us]" << std::endl;
+		if (built) {
+			report(progress, 0.7);
+			return;
+		}
+		// only points too close to call for every star end up here, and the hull settles them the same every time
+		out() << "Stars did not close, building the hull instead\n";
+	}
 
-	std::cout << "Building convex hull...\n";
-	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	// the hull and its builder only live until the vertices are translated
+	out() << "Building convex hull...\n";
+	begin = std::chrono::steady_clock::now();
+	quickhull::QuickHull<double> qh;
 	auto hull = qh.getConvexHull(qhpoints, true, false);
-	const auto &indexBuffer = hull.getIndexBuffer();
-	const auto &vertexBuffer = hull.getVertexBuffer();
-	qhpoints.clear();
-	ps.clear();
-	std::vector<polar_t> translated_vertices;
-	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
-	std::cout << "Elapsed: "
+	std::vector<quickhull::Vector3<double>>().swap(qhpoints);
+	end = std::chrono::steady_clock::now();
+	out() << "Elapsed: "
 		<< std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()
 		<< "[us]" << std::endl;
 
-	std::cout << "Translating vertices...\n";
+	if (stopped(progress))
+		return;
+	report(progress, 0.7);
+
+	out() << "Translating vertices...\n";
 	begin = std::chrono::steady_clock::now();
 
-	for (auto &v : vertexBuffer) {
-		double r = std::sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
-		translated_vertices.push_back(
-			polar_t(180.0 * std::atan2(v.y, v.x) / M_PI + 180.0, 180.0 * std::asin(v.z / r) / M_PI + 90.0)
-		);
-	}
+	const auto &vertexBuffer = hull.getVertexBuffer();
+	vertices.reserve(vertexBuffer.size());
+	for (auto &v : vertexBuffer)
+		vertices.push_back(to_polar(v.x, v.y, v.z));
+	corners.assign(hull.getIndexBuffer().begin(), hull.getIndexBuffer().end());
 
 	end = std::chrono::steady_clock::now();
-	std::cout << "Elapsed: "
+	out() << "Elapsed: "
 		<< std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()
 		<< "[us]" << std::endl;
+}
 
-	std::cout << "Building triangle surfaces...\n";
-	begin = std::chrono::steady_clock::now();
+/*
+ * A geodesic sphere: every face of an icosahedron, with a vertex on each
+ * pole, cut into n * n triangles, n chosen so there are about as many faces
+ * as the hull gives for the same face size. Vertex ids follow from where a
+ * vertex lies, so faces sharing one find the same id without a search: the
+ * 12 corners first, then the n - 1 inner points of each of the 30 edges
+ * counted from the edge's lower corner, then the inner points of each face.
+ * Every vertex may move by up to icosphere_jitter of an edge along each axis.
+ */
+void world_t::build_icosphere(const random_t &rng, column_vector_t<polar_t> &vertices, column_vector_t<uint32_t> &corners)
+{
+	out() << "Building icosphere...\n";
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
 
-	std::map<std::pair<polar_t, polar_t>, std::vector<surface_t *>> edge_map;
+	const double sphere = 4 * M_PI * (180 / M_PI) * (180 / M_PI);
+	const int n = std::max<long>(1, std::lround(std::sqrt(2 * sphere / (config.face_size * config.face_size) / 20)));
 
-	unsigned long long count = 0;
-	for (unsigned int i = 0; i < indexBuffer.size(); i += 3) {
-		std::vector<polar_t> ps = {
-			translated_vertices[indexBuffer[i]],
-			translated_vertices[indexBuffer[i + 1]],
-			translated_vertices[indexBuffer[i + 2]] };
-		surface_t *s;
-		if (ps[0][0] < ps[1][0] && ps[0][0] < ps[2][0]) {
-			s = new surface_t{
-			count,
-			ps[0],
-			ps[1],
-			ps[2] };
-		} else if (ps[1][0] < ps[0][0] && ps[1][0] < ps[2][0]) {
-			s = new surface_t{
-			count,
-			ps[1],
-			ps[2],
-			ps[0] };
-		} else {
-			s = new surface_t{
-			count,
-			ps[2],
-			ps[0],
-			ps[1] };
+	glm::dvec3 ico[12];
+	ico[0] = glm::dvec3(0, 0, 1);
+	ico[11] = glm::dvec3(0, 0, -1);
+	for (int k = 0; k < 5; k++) {
+		double upper = 2 * M_PI * k / 5, lower = upper + M_PI / 5;
+		ico[1 + k] = glm::dvec3(2 / std::sqrt(5.0) * std::cos(upper), 2 / std::sqrt(5.0) * std::sin(upper), 1 / std::sqrt(5.0));
+		ico[6 + k] = glm::dvec3(2 / std::sqrt(5.0) * std::cos(lower), 2 / std::sqrt(5.0) * std::sin(lower), -1 / std::sqrt(5.0));
+	}
+	std::vector<std::array<int, 3>> ico_faces;
+	for (int k = 0; k < 5; k++) {
+		int u = 1 + k, u2 = 1 + (k + 1) % 5, l = 6 + k, l2 = 6 + (k + 1) % 5;
+		ico_faces.push_back({ 0, u, u2 });
+		ico_faces.push_back({ u, l, u2 });
+		ico_faces.push_back({ u2, l, l2 });
+		ico_faces.push_back({ 11, l2, l });
+	}
+	// all faces wound the same way, outwards
+	for (auto &f : ico_faces) {
+		glm::dvec3 normal = glm::cross(ico[f[1]] - ico[f[0]], ico[f[2]] - ico[f[0]]);
+		if (glm::dot(normal, ico[f[0]] + ico[f[1]] + ico[f[2]]) < 0)
+			std::swap(f[1], f[2]);
+	}
+	std::vector<std::array<int, 2>> ico_edges;
+	auto edge = [&](const int &a, const int &b) {
+		std::array<int, 2> e = { std::min(a, b), std::max(a, b) };
+		auto it = std::find(ico_edges.begin(), ico_edges.end(), e);
+		if (it != ico_edges.end())
+			return (int)(it - ico_edges.begin());
+		ico_edges.push_back(e);
+		return (int)ico_edges.size() - 1;
+	};
+	for (auto &f : ico_faces) {
+		edge(f[0], f[1]);
+		edge(f[1], f[2]);
+		edge(f[2], f[0]);
+	}
+
+	const uint32_t edge_base = 12, face_base = edge_base + 30 * (n - 1);
+	const uint32_t inner = (n - 1) * (n - 2) / 2;
+	vertices.assign(face_base + 20 * inner, polar_t(0, 0));
+	const double spread = config.icosphere_jitter * 1.05 / n;
+	auto place = [&](const uint32_t &v, glm::dvec3 p) {
+		if (spread > 0)
+			p += spread * glm::dvec3(rng.uniform(v, 0) * 2 - 1, rng.uniform(v, 1) * 2 - 1, rng.uniform(v, 2) * 2 - 1);
+		vertices[v] = to_polar(p.x, p.y, p.z);
+	};
+	for (uint32_t v = 0; v < 12; v++)
+		place(v, ico[v]);
+	for (uint32_t e = 0; e < 30; e++) {
+		for (int t = 1; t < n; t++)
+			place(edge_base + e * (n - 1) + t - 1, ico[ico_edges[e][0]] * ((double)(n - t) / n) + ico[ico_edges[e][1]] * ((double)t / n));
+	}
+
+	// a face's points (i, j) weigh its corners n - i - j, i and j
+	corners.reserve(20 * 3 * n * n);
+	std::vector<uint32_t> grid((n + 1) * (n + 2) / 2);
+	auto at = [&](const int &i, const int &j) -> uint32_t & { return grid[j * (n + 1) - j * (j - 1) / 2 + i]; };
+	for (uint32_t f = 0; f < 20; f++) {
+		const int a = ico_faces[f][0], b = ico_faces[f][1], c = ico_faces[f][2];
+		// the id of the t-th inner point from corner p towards corner q
+		auto on_edge = [&](const int &p, const int &q, const int &t) {
+			return edge_base + edge(p, q) * (n - 1) + (p < q ? t : n - t) - 1;
+		};
+		uint32_t next = face_base + f * inner;
+		for (int j = 0; j <= n; j++) {
+			for (int i = 0; i + j <= n; i++) {
+				if (i == 0 && j == 0)
+					at(i, j) = a;
+				else if (i == n)
+					at(i, j) = b;
+				else if (j == n)
+					at(i, j) = c;
+				else if (j == 0)
+					at(i, j) = on_edge(a, b, i);
+				else if (i == 0)
+					at(i, j) = on_edge(a, c, j);
+				else if (i + j == n)
+					at(i, j) = on_edge(b, c, j);
+				else {
+					at(i, j) = next;
+					place(next++, ico[a] * ((double)(n - i - j) / n) + ico[b] * ((double)i / n) + ico[c] * ((double)j / n));
+				}
+			}
 		}
+		for (int j = 0; j < n; j++) {
+			for (int i = 0; i + j < n; i++) {
+				corners.insert(corners.end(), { at(i, j), at(i + 1, j), at(i, j + 1) });
+				if (i + j + 1 < n)
+					corners.insert(corners.end(), { at(i + 1, j), at(i + 1, j + 1), at(i, j + 1) });
+			}
+		}
+	}
 
-		if (s->a < s->b)
-			edge_map[{s->a, s->b}].push_back(s);
-		else
-			edge_map[{s->b, s->a}].push_back(s);
-		if (s->b < s->c)
-			edge_map[{s->b, s->c}].push_back(s);
-		else
-			edge_map[{s->c, s->b}].push_back(s);
-		if (s->c < s->a)
-			edge_map[{s->c, s->a}].push_back(s);
-		else
-			edge_map[{s->a, s->c}].push_back(s);
-		faces.push_back(s);
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	out() << "Elapsed: "
+		<< std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()
+		<< "[us]" << std::endl;
+	report(progress, 0.7);
+}
+
+void world_t::build_mesh(const random_t &rng)
+{
+	clear_mesh();
+
+	// shared vertices, and the corners of every face as vertex ids
+	column_vector_t<polar_t> vertices;
+	column_vector_t<uint32_t> indices;
+	if (config.mesh_source == world_config_t::MESH_ICOSPHERE)
+		build_icosphere(rng, vertices, indices);
+	else
+		build_hull(rng, vertices, indices);
+	if (stopped(progress))
+		return;
+
+	out() << "Building triangle surfaces...\n";
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
 
-		sections[(size_t)(s->get_center()[0] / 10.0f)][(size_t)(s->get_center()[1] / 10.0f)].members.push_back(s);
+	// the corners again, in the order the faces keep them
+	column_vector_t<uint32_t> corners;
+	corners.reserve(indices.size());
+	surfaces.reserve(indices.size() / 3);
+	faces.reserve(indices.size() / 3);
+
+	unsigned long long count = 0;
+	for (size_t i = 0; i < indices.size(); i += 3) {
+		const polar_t ps[3] = {
+			vertices[indices[i]],
+			vertices[indices[i + 1]],
+			vertices[indices[i + 2]] };
+		int first;
+		if (ps[0][0] < ps[1][0] && ps[0][0] < ps[2][0])
+			first = 0;
+		else if (ps[1][0] < ps[0][0] && ps[1][0] < ps[2][0])
+			first = 1;
+		else
+			first = 2;
+		surfaces.emplace_back(
+			count,
+			ps[first],
+			ps[(first + 1) % 3],
+			ps[(first + 2) % 3]);
+		faces.push_back(&surfaces.back());
+		for (int k = 0; k < 3; k++)
+			corners.push_back(indices[i + (first + k) % 3]);
 
 		count++;
 	}
 
-	translated_vertices.clear();
+	const size_t vertex_count = vertices.size();
+	column_vector_t<polar_t>().swap(vertices);
+	column_vector_t<uint32_t>().swap(indices);
+	index.build(faces);
+	traversal.resize(faces.size());
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	out() << "Elapsed: "
+		<< std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()
+		<< "[us]" << std::endl;
+
+	report(progress, 0.9);
+
+	out() << "Setting neighbors...\n";
+	begin = std::chrono::steady_clock::now();
+	topology.build(corners, vertex_count);
+	set_neighbors();
 	end = std::chrono::steady_clock::now();
-	std::cout << "Elapsed: "
+	out() << "Elapsed: "
+		<< std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()
+		<< "[us]" << std::endl;
+}
+
+void world_t::link_parents()
+{
+	out() << "Linking Parents...\n";
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	parents.assign(faces.size(), 0);
+	parallel_for(faces.size(), [&](const size_t &from, const size_t &to) {
+		for (size_t i = from; i < to; i++)
+			parents[i] = coarse->index.nearest(faces[i]->get_center_c()).first->ID;
+	});
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	out() << "Elapsed: "
 		<< std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()
 		<< "[us]" << std::endl;
+}
+
+// every face's type as the named stage left it
+std::vector<surface_t::surface_type> world_t::stage_types(const std::string &name) const
+{
+	std::vector<surface_t::surface_type> types(faces.size(), surface_t::FACE_WATER);
+	for (size_t s = 0; s < stages.stages.size(); s++) {
+		if (stages.stages[s].name != name)
+			continue;
+		caches[s].type.tiles<surface_t::surface_type>([&](const size_t &first, const size_t &n, surface_t::surface_type *v) {
+			std::copy(v, v + n, types.begin() + first);
+		});
+	}
+	return types;
+}
 
-	std::cout << "Setting neighbors...\n";
+void world_t::inherit_layout()
+{
+	std::chrono::steady_clock::time_point begin, end;
+	out() << "Inheriting Layout...\n";
 	begin = std::chrono::steady_clock::now();
-	for (auto &e : edge_map) {
-		for (auto &s : e.second) {
-			for (auto &s2 : e.second) {
-				if (s == s2)
-					continue;
-				s->neighbors.push_back(s2);
-			}
+	const std::vector<surface_t::surface_type> layout = coarse->stage_types("deep ocean");
+	// the warp reaches about one coarse face and changes over about as far
+	const double spacing = coarse->config.face_size * M_PI / 180;
+	parallel_for(faces.size(), [&](const size_t &from, const size_t &to) {
+		for (size_t i = from; i < to; i++) {
+			surface_t *f = faces[i];
+			const surface_t *p = coarse->faces[parents[i]];
+			f->type = layout[p->ID];
+			bool border = false;
+			for (auto &n : p->neighbors)
+				border |= layout[n->ID] != layout[p->ID];
+			if (!border)
+				continue;
+			point3_t c = f->get_center_c();
+			double x = c[0] / spacing, y = c[1] / spacing, z = c[2] / spacing;
+			double wx = c[0] + SimplexNoise::noise(600 + noise_offset + x, y, z) * spacing;
+			double wy = c[1] + SimplexNoise::noise(700 + noise_offset + x, y, z) * spacing;
+			double wz = c[2] + SimplexNoise::noise(800 + noise_offset + x, y, z) * spacing;
+			double r = std::sqrt(wx * wx + wy * wy + wz * wz);
+			f->type = layout[coarse->index.nearest(point3_t(wx / r, wy / r, wz / r)).first->ID];
 		}
+	});
+	end = std::chrono::steady_clock::now();
+	out() << "Elapsed: "
+		<< std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()
+		<< "[us]" << std::endl;
+}
+
+void world_t::inherit_deep_roots()
+{
+	std::chrono::steady_clock::time_point begin, end;
+	out() << "Inheriting Deep Ocean Roots...\n";
+	begin = std::chrono::steady_clock::now();
+	deep_roots.clear();
+	for (auto &r : coarse->deep_roots) {
+		surface_t *f = index.nearest(r->get_center_c()).first;
+		if (f->type == surface_t::FACE_DEEP_OCEAN && std::find(deep_roots.begin(), deep_roots.end(), f) == deep_roots.end())
+			deep_roots.push_back(f);
 	}
-	edge_map.clear();
 	end = std::chrono::steady_clock::now();
-	std::cout << "Elapsed: "
+	out() << "Elapsed: "
 		<< std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()
 		<< "[us]" << std::endl;
+}
 
-	std::cout << "Setting Islands...\n";
+void world_t::inherit_springs()
+{
+	std::chrono::steady_clock::time_point begin, end;
+	out() << "Inheriting Springs...\n";
 	begin = std::chrono::steady_clock::now();
-	for (auto i = 0; i < ISLAND_SEED_COUNT; i++) {
-		auto origin = faces[rand() % faces.size()];
-		double size = ((double)rand() / (double)RAND_MAX) * 0.4 + 0.1;
-		for (auto &e : faces) {
-			if (true_dist(origin, e) < size)
-				iterate_land(e, ISLAND_BRANCHING_SIZE);
-		}
+	// springs are what the springs stage made flowing, deep ocean roots turned flowing before it are inherited already
+	const std::vector<surface_t::surface_type> before = coarse->stage_types("water types");
+	const std::vector<surface_t::surface_type> after = coarse->stage_types("springs");
+	for (auto &p : coarse->faces) {
+		if (after[p->ID] != surface_t::FACE_FLOWING || before[p->ID] == surface_t::FACE_FLOWING)
+			continue;
+		surface_t *f = index.nearest(p->get_center_c()).first;
+		if (f->type == surface_t::FACE_LAND)
+			f->type = surface_t::FACE_FLOWING;
+	}
+	end = std::chrono::steady_clock::now();
+	out() << "Elapsed: "
+		<< std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()
+		<< "[us]" << std::endl;
+}
+
+void world_t::set_islands(const random_t &rng)
+{
+	std::chrono::steady_clock::time_point begin, end;
+	out() << "Setting Islands...\n";
+	begin = std::chrono::steady_clock::now();
+	for (auto i = 0; i < config.island_seed_count; i++) {
+		if (stopped(progress))
+			return;
+		report(progress, (double)i / config.island_seed_count);
+		// a point drawn on the sphere rather than a face ID, so the island starts in the same place at any face size
+		double z = rng.uniform(i, 0) * 2.0 - 1.0;
+		double phi = rng.uniform(i, 2) * 2.0 * M_PI;
+		double r = std::sqrt(MAX<double>(0.0, 1.0 - z * z));
+		auto origin = index.nearest(point3_t(r * std::cos(phi), r * std::sin(phi), z)).first;
+		double size = rng.uniform(i, 1) * 0.4 + 0.1;
+		iterate_land(index.cap(origin->get_center_c(), size), config.island_branching_size);
 	}
 	end = std::chrono::steady_clock::now();
-	std::cout << "Elapsed: "
+	out() << "Elapsed: "
 		<< std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()
 		<< "[us]" << std::endl;
+}
 
-	std::cout << "Setting Deep Ocean Islands...\n";
+void world_t::set_deep_ocean(const random_t &rng)
+{
+	std::chrono::steady_clock::time_point begin, end;
+	out() << "Setting Deep Ocean Islands...\n";
+	begin = std::chrono::steady_clock::now();
 	std::vector<surface_t *> deep;
 	std::vector<surface_t *> deep2;
+	distance_field_t land_field = build_field(surface_t::FACE_LAND);
+	if (stopped(progress))
+		return;
+
+	// classify in parallel, then collect in face order so the ordering below sees the same lists
+	std::vector<unsigned char> band(faces.size(), 0);
+	parallel_for(faces.size(), [&](const size_t &from, const size_t &to) {
+		for (size_t i = from; i < to; i++) {
+			surface_t *f = faces[i];
+			if (f->type != surface_t::FACE_WATER || land_field[f].second <= 0.2)
+				continue;
+			point3_t cc = f->get_center_c();
+			double pm = SimplexNoise::noise(200 + noise_offset + cc[0] / 2.0, cc[1] / 2.0, cc[2] / 2.0);
+			double pm2 = SimplexNoise::noise(400 + noise_offset + cc[0] / 2.0, cc[1] / 2.0, cc[2] / 2.0);
+			if (pm > -0.1 && pm < 0.1)
+				band[i] = 1;
+			else if (pm2 > -0.1 && pm2 < 0.1)
+				band[i] = 2;
+		}
+	});
 	for (auto &f : faces) {
-		if (f->type != surface_t::FACE_WATER)
+		if (band[f->ID] == 0)
 			continue;
-		auto dist = find_nearest(f, surface_t::FACE_LAND);
-		point3_t cc = f->get_center_c();
-		double pm = SimplexNoise::noise(200 + noise_offset + cc[0] / 2.0, cc[1] / 2.0, cc[2] / 2.0);
-		double pm2 = SimplexNoise::noise(400 + noise_offset + cc[0] / 2.0, cc[1] / 2.0, cc[2] / 2.0);
-		if (dist.second > 0.2) {
-			if (pm > -0.1 && pm < 0.1) {
-				f->type = surface_t::FACE_DEEP_OCEAN;
-				deep.push_back(f);
-			} else if (pm2 > -0.1 && pm2 < 0.1) {
-				f->type = surface_t::FACE_DEEP_OCEAN;
-				deep2.push_back(f);
-			}
-		}
+		f->type = surface_t::FACE_DEEP_OCEAN;
+		(band[f->ID] == 1 ? deep : deep2).push_back(f);
 	}
-	begin = std::chrono::steady_clock::now();
-	std::random_shuffle(deep.begin(), deep.end());
+	// a shuffle keyed by face ID, so the order does not depend on how the list was built
+	std::sort(deep.begin(), deep.end(), [&](const surface_t *a, const surface_t *b) {
+		uint64_t ka = rng.bits(a->ID), kb = rng.bits(b->ID);
+		return ka != kb ? ka < kb : a->ID < b->ID;
+	});
 
-	std::vector<surface_t *> roots;
+	deep_roots.clear();
 
+	// island widths are steps between faces of FACE_SIZE, so they keep their size on the sphere at other face sizes
+	const double steps = FACE_SIZE / config.face_size;
 	for (int i = 0; i < 64; i++) {
 		if (deep.empty())
 			break;
@@ -444,8 +1102,8 @@ world_t::world_t(const int &SEED)
 			i--;
 			continue;
 		}
-		roots.push_back(root);
-		iterate_land(root, (double)rand() / (double)RAND_MAX * 4.0);
+		deep_roots.push_back(root);
+		iterate_land({ root }, rng.uniform(root->ID, 1) * 4.0 * steps);
 	}
 
 	for (int i = 0; i < 32; i++) {
@@ -459,8 +1117,8 @@ world_t::world_t(const int &SEED)
 			i--;
 			continue;
 		}
-		roots.push_back(root);
-		iterate_land(root, (double)rand() / (double)RAND_MAX * 8.0);
+		deep_roots.push_back(root);
+		iterate_land({ root }, rng.uniform(root->ID, 2) * 8.0 * steps);
 	}
 
 	for (auto &f : deep) {
@@ -476,174 +1134,776 @@ world_t::world_t(const int &SEED)
 	deep.clear();
 	deep2.clear();
 	end = std::chrono::steady_clock::now();
-	std::cout << "Elapsed: "
+	out() << "Elapsed: "
+		<< std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()
+		<< "[us]" << std::endl;
+}
+
+void world_t::set_noise()
+{
+	std::chrono::steady_clock::time_point begin, end;
+	out() << "Setting Noise...\n";
+	begin = std::chrono::steady_clock::now();
+	// only depends on the mesh and the seed, so it runs while the islands are being grown
+	height_noise.assign(faces.size(), 0);
+	aridity_noise.assign(faces.size(), 0);
+	parallel_for(faces.size(), [&](const size_t &from, const size_t &to) {
+		for (size_t i = from; i < to; i++) {
+			surface_t *f = faces[i];
+			point3_t cc = f->get_center_c();
+			height_noise[i] =
+				SimplexNoise::noise(noise_offset + cc[0], cc[1], cc[2]) * 0.5 +
+				SimplexNoise::noise(noise_offset + cc[0] * 2.0, cc[1] * 2.0, cc[2] * 2.0) * 0.25 +
+				SimplexNoise::noise(noise_offset + cc[0] * 4.0, cc[1] * 4.0, cc[2] * 4.0) * 0.15 +
+				SimplexNoise::noise(noise_offset + cc[0] * 8.0, cc[1] * 8.0, cc[2] * 8.0) * 0.1;
+			aridity_noise[i] = aridity_noise_at(noise_offset, f);
+		}
+	});
+	end = std::chrono::steady_clock::now();
+	out() << "Elapsed: "
 		<< std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()
 		<< "[us]" << std::endl;
+}
 
-	std::cout << "Setting Height Map...\n";
+void world_t::set_heights()
+{
+	std::chrono::steady_clock::time_point begin, end;
+	out() << "Setting Height Map...\n";
 	begin = std::chrono::steady_clock::now();
-	for (auto &f : faces) {
-		if (f->type != surface_t::FACE_LAND)
-			continue;
-		std::pair<surface_t *, double> n = find_nearest(f, surface_t::FACE_WATER);
-		point3_t cc = f->get_center_c();
-		double pm =
-			SimplexNoise::noise(noise_offset + cc[0], cc[1], cc[2]) * 0.5 +
-			SimplexNoise::noise(noise_offset + cc[0] * 2.0, cc[1] * 2.0, cc[2] * 2.0) * 0.25 +
-			SimplexNoise::noise(noise_offset + cc[0] * 4.0, cc[1] * 4.0, cc[2] * 4.0) * 0.15 +
-			SimplexNoise::noise(noise_offset + cc[0] * 8.0, cc[1] * 8.0, cc[2] * 8.0) * 0.1;
-		f->height = MAX<double>(0.0, n.second * 2.0 + pm / 3.0) * HEIGHT_MULTIPLIER;
-	}
+	distance_field_t water_field = build_field(surface_t::FACE_WATER);
+	if (stopped(progress))
+		return;
+	parallel_for(faces.size(), [&](const size_t &from, const size_t &to) {
+		for (size_t i = from; i < to; i++) {
+			surface_t *f = faces[i];
+			if (f->type != surface_t::FACE_LAND)
+				continue;
+			std::pair<surface_t *, double> n = water_field[f];
+			f->height = MAX<double>(0.0, n.second * 2.0 + height_noise[f->ID] / 3.0) * config.height_multiplier;
+		}
+	});
 	end = std::chrono::steady_clock::now();
-	std::cout << "Elapsed: "
+	out() << "Elapsed: "
 		<< std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()
 		<< "[us]" << std::endl;
+}
 
-	std::cout << "Setting Water Types...\n";
+void world_t::set_water_types(const random_t &rng)
+{
+	std::chrono::steady_clock::time_point begin, end;
+	out() << "Setting Water Types...\n";
 	begin = std::chrono::steady_clock::now();
 
-	for (auto &f : roots) {
-		if (!f->borders_ocean() && rand() % 2 == 0)
+	for (auto &f : deep_roots) {
+		if (!f->borders_ocean() && rng.below(2, f->ID) == 0)
 			f->type = surface_t::FACE_FLOWING;
 	}
-	roots.clear();
-	for (auto &f : faces) {
-		if (f->type != surface_t::FACE_WATER)
-			continue;
-		auto water = get_water_extent(f);
-		if (water.size() < INLAND_LAKE_SIZE) {
-			for (auto &e : water) {
-				e->height = find_nearest(e, surface_t::FACE_LAND).first->height;
-				e->type = surface_t::FACE_LAND;
-			}
-		} else {
-			for (auto &e : water) {
-				e->type = surface_t::FACE_OCEAN;
+	distance_field_t land_field = build_field(surface_t::FACE_LAND);
+	if (stopped(progress))
+		return;
+	components_t water = build_components(surface_t::FACE_WATER);
+	// a face only reads its own type and the height of a land face, which no face here writes
+	parallel_for(faces.size(), [&](const size_t &from, const size_t &to) {
+		for (size_t i = from; i < to; i++) {
+			surface_t *f = faces[i];
+			if (f->type != surface_t::FACE_WATER)
+				continue;
+			if (water[f]->size < (size_t)MAX(0, config.inland_lake_size)) {
+				// a world without land has no shore to take the height from
+				const surface_t *shore = land_field[f].first;
+				if (shore != NULL)
+					f->height = shore->height;
+				f->type = surface_t::FACE_LAND;
+			} else {
+				f->type = surface_t::FACE_OCEAN;
 			}
 		}
-	}
+	});
 	end = std::chrono::steady_clock::now();
-	std::cout << "Elapsed: "
+	out() << "Elapsed: "
 		<< std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()
 		<< "[us]" << std::endl;
+}
+
+void world_t::erode_terrain()
+{
+	std::chrono::steady_clock::time_point begin, end;
+	if (config.erosion_iterations > 0) {
+		out() << "Eroding Terrain...\n";
+		begin = std::chrono::steady_clock::now();
+		erode(faces, config.erosion_iterations, progress);
+		end = std::chrono::steady_clock::now();
+		out() << "Elapsed: "
+			<< std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()
+			<< "[us]" << std::endl;
+	}
+}
 
-	std::cout << "Setting Springs...\n";
+void world_t::set_springs(const random_t &rng)
+{
+	std::chrono::steady_clock::time_point begin, end;
+	out() << "Setting Springs...\n";
 	begin = std::chrono::steady_clock::now();
-	for (auto &f : faces) {
-		if (f->type != surface_t::FACE_LAND || (f->height < 0.4 && f->height > 0.5)) {
-			continue;
+	// each face draws from its own ID, so the chunks need not agree on an order
+	parallel_for(faces.size(), [&](const size_t &from, const size_t &to) {
+		for (size_t i = from; i < to; i++) {
+			surface_t *f = faces[i];
+			if (f->type != surface_t::FACE_LAND || (f->height < 0.4 && f->height > 0.5)) {
+				continue;
+			}
+			if (rng.below(128, f->ID) == 0)
+				f->type = surface_t::FACE_FLOWING;
 		}
-		if (rand() % 128 == 0)
-			f->type = surface_t::FACE_FLOWING;
-	}
+	});
 	end = std::chrono::steady_clock::now();
-	std::cout << "Elapsed: "
+	out() << "Elapsed: "
 		<< std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()
 		<< "[us]" << std::endl;
+}
 
-	std::cout << "Setting Rivers...\n";
+void world_t::set_rivers()
+{
+	std::chrono::steady_clock::time_point begin, end;
+	out() << "Setting Rivers...\n";
 	begin = std::chrono::steady_clock::now();
-	//iterate_rivers(set);
-	while (iterate_rivers());
+	terrain.resize(faces.size());
+	for (auto &f : faces)
+		terrain[f->ID] = f->type;
+	hydrology_t hydrology = cluster.enabled() ? cluster.flood(faces, stage_name()) : hydrology_t(faces, progress);
+	if (stopped(progress))
+		return;
+	hydrology.carve(faces, traversal, progress);
+	if (stopped(progress))
+		return;
 
 	for (auto &f : faces) {
 		if (f->type == surface_t::FACE_STAGNANT)
 			f->type = surface_t::FACE_INLAND_LAKE;
 	}
 	end = std::chrono::steady_clock::now();
-	std::cout << "Elapsed: "
+	out() << "Elapsed: "
 		<< std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()
 		<< "[us]" << std::endl;
+}
 
-	std::cout << "Setting Aridity Map...\n";
-	begin = std::chrono::steady_clock::now();
-	for (auto &f : faces) {
-		if (f->type != surface_t::FACE_LAND)
-			continue;
-		std::pair<surface_t *, double> n = find_nearest(f, surface_t::FACE_INLAND_LAKE);
-		point3_t cc = f->get_center_c();
-		double pm =
-			SimplexNoise::noise(noise_offset + cc[0] + 100, cc[1], cc[2]) * 0.5 +
-			SimplexNoise::noise(noise_offset + cc[0] * 2.0 + 100, cc[1] * 2.0, cc[2] * 2.0) * 0.25 +
-			SimplexNoise::noise(noise_offset + cc[0] * 4.0 + 100, cc[1] * 4.0, cc[2] * 4.0) * 0.15 +
-			SimplexNoise::noise(noise_offset + cc[0] * 8.0 + 100, cc[1] * 8.0, cc[2] * 8.0) * 0.1;
-		f->aridity = MAX<double>(0.0, std::pow(n.second, 0.6) * 2.0 + pm / 2.0) * ARIDITY_MULTIPLIER;
+void world_t::set_aridity()
+{
+	std::chrono::steady_clock::time_point begin, end;
+	if (config.lazy_fields) {
+		out() << "Deferring Aridity Map...\n";
+		begin = std::chrono::steady_clock::now();
+		lazy = true;
+		aridity_state.reset(new std::atomic<unsigned char>[faces.size()]);
+		for (size_t i = 0; i < faces.size(); i++)
+			aridity_state[i].store(0);
+		aridity_count = 0;
+		moisture_ready = false;
+		end = std::chrono::steady_clock::now();
+		out() << "Elapsed: "
+			<< std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()
+			<< "[us]" << std::endl;
+		return;
 	}
-	end = std::chrono::steady_clock::now();
-	std::cout << "Elapsed: "
-		<< std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()
-		<< "[us]" << std::endl;
 
-	std::cout << "Setting Foehn Map...\n";
+	out() << "Setting Aridity Map...\n";
 	begin = std::chrono::steady_clock::now();
-	set_foehn();
+	lazy = false;
+	delete lake_field;
+	lake_field = NULL;
+	column_vector_t<double> dryness = get_dryness();
+	parallel_for(faces.size(), [&](const size_t &from, const size_t &to) {
+		for (size_t i = from; i < to; i++) {
+			surface_t *f = faces[i];
+			if (f->type == surface_t::FACE_LAND)
+				f->aridity = MAX<double>(0.0, dryness[f->ID] + aridity_noise[f->ID]) * config.aridity_multiplier;
+		}
+	});
 	end = std::chrono::steady_clock::now();
-	std::cout << "Elapsed: "
+	out() << "Elapsed: "
 		<< std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()
 		<< "[us]" << std::endl;
+}
 
-	std::cout << "Setting Landmass Map...\n";
-	begin = std::chrono::steady_clock::now();
-	for (auto &s : faces) {
-		if (s->landmass == NULL) {
-			landmass_t *l = new landmass_t{
-				(double)rand() / (double)RAND_MAX,
-				(double)rand() / (double)RAND_MAX,
-				(double)rand() / (double)RAND_MAX
-			};
-			s->landmass = l;
-			landmasses.push_back(l);
-			l->members.push_back(s);
-			make_landmasses(s);
+// stages that run side by side each write to their own log, printed in one piece when the stage is done
+static thread_local std::ostream *stage_log = NULL;
+static std::mutex print_lock;
+
+distance_field_t world_t::build_field(const surface_t::surface_type &type)
+{
+	if (cluster.enabled())
+		return cluster.distance_field(faces, type, stage_name());
+	return distance_field_t(faces, type, progress);
+}
+
+components_t world_t::build_components(const surface_t::surface_type &type)
+{
+	if (cluster.enabled())
+		return cluster.components(faces, type, stage_name());
+	return components_t(faces, type);
+}
+
+std::ostream &world_t::out()
+{
+	if (!config.verbose)
+		return silent;
+	return stage_log != NULL ? *stage_log : std::cout;
+}
+
+landmass_t *world_t::landmass_color(const size_t &root) const
+{
+	// keyed by the landmass's lowest face ID, so an edit and a full rebuild pick the same color
+	random_t colors(seed, "landmasses");
+	return new landmass_t{
+		colors.uniform(root, 0),
+		colors.uniform(root, 1),
+		colors.uniform(root, 2)
+	};
+}
+
+void world_t::add_stages()
+{
+	typedef world_config_t c;
+	size_t mesh = stages.add("mesh", 3, {}, c::CONFIG_FACE_SIZE | c::CONFIG_MESH_SOURCE, 0, [this](const random_t &rng) {
+		build_mesh(rng);
+		if (coarse != NULL && !stopped(progress))
+			link_parents();
+	});
+	size_t noise = stages.add("noise", 2, { mesh }, 0, 0, [this](const random_t &) { set_noise(); });
+	size_t islands = stages.add("islands", 3, { mesh }, c::CONFIG_ISLAND_SEED_COUNT | c::CONFIG_ISLAND_BRANCHING_SIZE, COLUMN_TYPE, [this](const random_t &rng) {
+		if (coarse != NULL)
+			inherit_layout();
+		else
+			set_islands(rng);
+	});
+	size_t deep = stages.add("deep ocean", 2, { islands }, 0, COLUMN_TYPE, [this](const random_t &rng) {
+		if (coarse != NULL)
+			inherit_deep_roots();
+		else
+			set_deep_ocean(rng);
+	});
+	size_t heights = stages.add("heights", 2, { deep, noise }, c::CONFIG_HEIGHT_MULTIPLIER, COLUMN_HEIGHT, [this](const random_t &) { set_heights(); });
+	size_t water = stages.add("water types", 2, { heights, deep }, c::CONFIG_INLAND_LAKE_SIZE, COLUMN_TYPE | COLUMN_HEIGHT, [this](const random_t &rng) { set_water_types(rng); });
+	size_t erosion = stages.add("erosion", 2, { water }, c::CONFIG_EROSION_ITERATIONS, COLUMN_HEIGHT, [this](const random_t &) { erode_terrain(); });
+	size_t springs = stages.add("springs", 2, { erosion }, 0, COLUMN_TYPE, [this](const random_t &rng) {
+		if (coarse != NULL)
+			inherit_springs();
+		else
+			set_springs(rng);
+	});
+	size_t rivers = stages.add("rivers", 2, { springs }, 0, COLUMN_TYPE, [this](const random_t &) { set_rivers(); });
+	size_t aridity = stages.add("aridity", 2, { rivers, noise }, c::CONFIG_ARIDITY_MULTIPLIER | c::CONFIG_MOISTURE | c::CONFIG_LAZY_FIELDS, COLUMN_ARIDITY, [this](const random_t &) { set_aridity(); });
+	size_t foehn = stages.add("foehn", 4, { rivers }, c::CONFIG_LAZY_FIELDS, COLUMN_FOEHN, [this](const random_t &) { set_foehn(); });
+	stages.add("landmasses", 2, { rivers }, 0, 0, [this](const random_t &) {
+		out() << "Setting Landmass Map...\n";
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		set_landmasses();
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+		out() << "Elapsed: "
+			<< std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()
+			<< "[us]" << std::endl;
+	});
+
+	// what a stage leaves behind besides its columns
+	stages.stages[mesh].save = [this](blob_t &blob) { save_mesh(blob); };
+	stages.stages[mesh].load = [this](blob_t &blob) {
+		if (!load_mesh(blob))
+			return false;
+		if (coarse != NULL)
+			link_parents();
+		return true;
+	};
+	stages.stages[deep].save = [this](blob_t &blob) {
+		std::vector<uint32_t> roots;
+		for (auto &f : deep_roots)
+			roots.push_back(f->ID);
+		blob.put(roots);
+	};
+	stages.stages[deep].load = [this](blob_t &blob) {
+		std::vector<uint32_t> roots;
+		if (!blob.get(roots))
+			return false;
+		for (auto &r : roots) {
+			if (r >= faces.size())
+				return false;
 		}
+		deep_roots.clear();
+		for (auto &r : roots)
+			deep_roots.push_back(faces[r]);
+		return true;
+	};
+	stages.stages[rivers].save = [this](blob_t &blob) { blob.put(terrain); };
+	stages.stages[rivers].load = [this](blob_t &blob) {
+		column_vector_t<surface_t::surface_type> loaded;
+		if (!blob.get(loaded) || loaded.size() != faces.size())
+			return false;
+		terrain.swap(loaded);
+		return true;
+	};
+	stages.stages[aridity].load = [this](blob_t &) {
+		lazy = false;
+		delete lake_field;
+		lake_field = NULL;
+		moisture_ready = false;
+		return true;
+	};
+	stages.stages[foehn].save = [this](blob_t &blob) { blob.put(this->foehn.get_parts()); };
+	stages.stages[foehn].load = [this](blob_t &blob) {
+		std::vector<foehn_part_t> parts;
+		if (!blob.get(parts))
+			return false;
+		this->foehn.build(faces, config.face_size);
+		return this->foehn.restore(parts);
+	};
+	caches.resize(stages.stages.size());
+	stage_seconds.assign(stages.stages.size(), 0);
+}
+
+// copies one snapshot column back onto the faces, a tile at a time
+void world_t::restore_column(const stage_cache_t &cache, const unsigned int &column)
+{
+	switch (column) {
+		case COLUMN_TYPE:
+			cache.type.tiles<surface_t::surface_type>([this](const size_t &first, const size_t &n, surface_t::surface_type *v) {
+				for (size_t i = 0; i < n; i++)
+					faces[first + i]->type = v[i];
+			});
+			break;
+		case COLUMN_HEIGHT:
+			cache.height.tiles<double>([this](const size_t &first, const size_t &n, double *v) {
+				for (size_t i = 0; i < n; i++)
+					faces[first + i]->height = v[i];
+			});
+			break;
+		case COLUMN_ARIDITY:
+			cache.aridity.tiles<double>([this](const size_t &first, const size_t &n, double *v) {
+				for (size_t i = 0; i < n; i++)
+					faces[first + i]->aridity = v[i];
+			});
+			break;
+		case COLUMN_FOEHN:
+			cache.foehn.tiles<double>([this](const size_t &first, const size_t &n, double *v) {
+				for (size_t i = 0; i < n; i++)
+					faces[first + i]->foehn = v[i];
+			});
+			break;
 	}
-	end = std::chrono::steady_clock::now();
-	std::cout << "Elapsed: "
-		<< std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()
-		<< "[us]" << std::endl;
+}
 
-	std::cout << "---------------------------------\n";
-	std::cout << "Face Count: " << faces.size() << "\n";
-	std::cout << "---------------------------------\n";
+void world_t::save_stage(const size_t &s, blob_t &blob)
+{
+	if (stages.stages[s].save)
+		stages.stages[s].save(blob);
+	caches[s].type.put(blob);
+	caches[s].height.put(blob);
+	caches[s].aridity.put(blob);
+	caches[s].foehn.put(blob);
+}
 
-	std::cout << "Done.\n";
+bool world_t::load_stage(const size_t &s, blob_t &blob)
+{
+	// a hook only replaces state the stage's own run would rebuild; faces are not touched until the columns fit
+	stage_t &stage = stages.stages[s];
+	if (stage.load && !stage.load(blob))
+		return false;
+	stage_cache_t loaded;
+	if (!loaded.type.get(blob, &columns, sizeof(surface_t::surface_type)) || !loaded.height.get(blob, &columns, sizeof(double))
+		|| !loaded.aridity.get(blob, &columns, sizeof(double)) || !loaded.foehn.get(blob, &columns, sizeof(double)))
+		return false;
+	const size_t n = faces.size();
+	if (loaded.type.size() != ((stage.outputs & COLUMN_TYPE) ? n : 0)
+		|| loaded.height.size() != ((stage.outputs & COLUMN_HEIGHT) ? n : 0)
+		|| loaded.aridity.size() != ((stage.outputs & COLUMN_ARIDITY) ? n : 0)
+		|| loaded.foehn.size() != ((stage.outputs & COLUMN_FOEHN) ? n : 0))
+		return false;
+	restore_column(loaded, stage.outputs & COLUMN_TYPE);
+	restore_column(loaded, stage.outputs & COLUMN_HEIGHT);
+	restore_column(loaded, stage.outputs & COLUMN_ARIDITY);
+	restore_column(loaded, stage.outputs & COLUMN_FOEHN);
+	caches[s] = std::move(loaded);
+	return true;
 }
 
+void world_t::run_stage(const size_t &s, const size_t &index, const uint64_t &key, std::mutex &cache_lock)
+{
+	if (stopped(progress))
+		return;
+	if (progress != NULL)
+		progress->begin(stages.stages[s].name, index);
+	std::ostringstream log;
+	stage_log = &log;
+	current_stage = &stages.stages[s].name;
+	column_scope_t scope(&columns);
+	std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+
+	// deferred fields have nothing worth keeping, and a stage that writes nothing is cheap to rerun
+	const stage_t &stage = stages.stages[s];
+	bool persist = disk_cache.enabled() && (stage.outputs != 0 || stage.save)
+		&& !(config.lazy_fields && (stage.outputs & (COLUMN_ARIDITY | COLUMN_FOEHN)));
+	bool loaded = false;
+	if (persist) {
+		blob_t blob;
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		std::unique_lock<std::mutex> guard(cache_lock);
+		if (disk_cache.load(key, blob)) {
+			guard.unlock();
+			loaded = load_stage(s, blob);
+			guard.lock();
+			if (!loaded)
+				disk_cache.reject();
+		}
+		guard.unlock();
+		if (loaded) {
+			report(progress, 1.0);
+			std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+			stage_seconds[s] = std::chrono::duration<double>(end - started).count();
+			out() << "Loaded " << stage.name << " from cache\n";
+			out() << "Elapsed: "
+				<< std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()
+				<< "[us]" << std::endl;
+		}
+	}
+	if (!loaded) {
+		stage.run(random_t(seed, stage.name));
+		if (!stopped(progress)) {
+			report(progress, 1.0);
+			stage_seconds[s] = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+			stage_cache_t &cache = caches[s];
+			const unsigned int outputs = stage.outputs;
+			cache.type.reset(&columns, (outputs & COLUMN_TYPE) ? faces.size() : 0, sizeof(surface_t::surface_type));
+			cache.height.reset(&columns, (outputs & COLUMN_HEIGHT) ? faces.size() : 0, sizeof(double));
+			cache.aridity.reset(&columns, (outputs & COLUMN_ARIDITY) ? faces.size() : 0, sizeof(double));
+			cache.foehn.reset(&columns, (outputs & COLUMN_FOEHN) ? faces.size() : 0, sizeof(double));
+			cache.type.tiles<surface_t::surface_type>([this](const size_t &first, const size_t &n, surface_t::surface_type *v) {
+				for (size_t i = 0; i < n; i++)
+					v[i] = faces[first + i]->type;
+			});
+			cache.height.tiles<double>([this](const size_t &first, const size_t &n, double *v) {
+				for (size_t i = 0; i < n; i++)
+					v[i] = faces[first + i]->height;
+			});
+			cache.aridity.tiles<double>([this](const size_t &first, const size_t &n, double *v) {
+				for (size_t i = 0; i < n; i++)
+					v[i] = faces[first + i]->aridity;
+			});
+			cache.foehn.tiles<double>([this](const size_t &first, const size_t &n, double *v) {
+				for (size_t i = 0; i < n; i++)
+					v[i] = faces[first + i]->foehn;
+			});
+			if (persist) {
+				blob_t blob;
+				save_stage(s, blob);
+				std::lock_guard<std::mutex> guard(cache_lock);
+				disk_cache.store(key, blob);
+			}
+		}
+	}
+
+	stage_log = NULL;
+	current_stage = NULL;
+	columns.trim();
+	if (log.tellp() > 0) {
+		std::lock_guard<std::mutex> guard(print_lock);
+		std::cout << log.str() << std::flush;
+	}
+}
 
-world_t::world_t(const std::vector<surface_t *> &faces)
-	: faces(faces)
+bool world_t::run_stages(const std::vector<bool> &dirty)
 {
-	for (auto &s : faces) {
-		if (s->landmass == NULL) {
-			landmass_t *l = new landmass_t{
-				(double)rand() / (double)RAND_MAX,
-				(double)rand() / (double)RAND_MAX,
-				(double)rand() / (double)RAND_MAX
-			};
-			s->landmass = l;
-			landmasses.push_back(l);
-			l->members.push_back(s);
-			make_landmasses(s);
+	size_t first = stage_graph_t::NONE;
+	size_t count = 0;
+	unsigned int written = 0;
+	for (size_t s = 0; s < dirty.size(); s++) {
+		if (!dirty[s])
+			continue;
+		if (first == stage_graph_t::NONE)
+			first = s;
+		count++;
+		written |= stages.stages[s].outputs;
+	}
+	if (first == stage_graph_t::NONE)
+		return true;
+
+	disk_cache.directory = config.cache_directory;
+	disk_cache.stats = cache_stats_t();
+	cluster.workers = config.workers;
+	cluster.band_size = config.face_size;
+	cluster.clear_stats();
+	columns.directory = config.column_directory;
+	columns.budget = config.column_budget;
+	std::vector<uint64_t> keys = stages.keys([this](hasher_t &h, const unsigned int &params) {
+		h.add(seed);
+		config.hash(h, params);
+	});
+
+	// columns the dirty stages write start out as the last clean stage before them left them
+	for (unsigned int column = 1; column <= COLUMN_FOEHN; column <<= 1) {
+		if ((written & column) == 0)
+			continue;
+		size_t from = stages.producer(first, column, dirty);
+		if (from != stage_graph_t::NONE) {
+			restore_column(caches[from], column);
+			continue;
+		}
+		for (auto &f : faces) {
+			switch (column) {
+				case COLUMN_TYPE:
+					f->type = surface_t::FACE_WATER;
+					break;
+				case COLUMN_HEIGHT:
+					f->height = 0;
+					break;
+				case COLUMN_ARIDITY:
+					f->aridity = 0;
+					break;
+				case COLUMN_FOEHN:
+					f->foehn = 0;
+					break;
+			}
+		}
+	}
+
+	// a stage waits for its dirty inputs and for dirty stages before it that write one of its columns
+	task_graph_t graph;
+	std::vector<size_t> tasks(dirty.size(), stage_graph_t::NONE);
+	std::mutex cache_lock;
+	size_t done = 0;
+	if (progress != NULL)
+		progress->start(count);
+	for (size_t s = first; s < dirty.size(); s++) {
+		if (!dirty[s])
+			continue;
+		std::vector<size_t> after;
+		for (auto &i : stages.stages[s].inputs) {
+			if (tasks[i] != stage_graph_t::NONE)
+				after.push_back(tasks[i]);
 		}
+		for (size_t t = first; t < s; t++) {
+			if (tasks[t] != stage_graph_t::NONE && (stages.stages[t].outputs & stages.stages[s].outputs))
+				after.push_back(tasks[t]);
+		}
+		size_t index = done++;
+		uint64_t key = keys[s];
+		tasks[s] = graph.add(stages.stages[s].name, after, [this, s, index, key, &cache_lock]() {
+			run_stage(s, index, key, cache_lock);
+		});
+	}
+	graph.run();
+	timeline = graph.timeline;
+	// a cancelled stage stops wherever it noticed, so nothing it left may be kept
+	if (stopped(progress))
+		return false;
+
+	index.sync();
+	delete sea_levels;
+	sea_levels = NULL;
+
+	if (disk_cache.enabled()) {
+		out() << "Stage Cache: " << disk_cache.stats.hits << " hits, " << disk_cache.stats.misses << " misses, "
+			<< disk_cache.stats.bytes_read << " bytes read, " << disk_cache.stats.bytes_written << " bytes written\n";
 	}
+	if (columns.enabled()) {
+		column_stats_t c = columns.get_stats();
+		out() << "Columns: " << c.maps << " tiles mapped, " << c.mapped_bytes << " bytes mapped, " << c.peak_bytes << " bytes at most\n";
+	}
+	for (auto &e : cluster.get_stats()) {
+		out() << "Exchanged " << e.first << ": " << e.second.bytes << " bytes, " << e.second.halo_faces << " halo faces in "
+			<< e.second.rounds << " rounds over " << e.second.runs << " passes\n";
+	}
+	return true;
 }
 
-surface_t *world_t::find_closest(const double &yaw, const double &pit)
+unsigned int world_config_t::diff(const world_config_t &c) const
 {
-	double d = 100.0;
-	surface_t *curr = NULL;
+	unsigned int changed = 0;
+	if (face_size != c.face_size)
+		changed |= CONFIG_FACE_SIZE;
+	if (island_seed_count != c.island_seed_count)
+		changed |= CONFIG_ISLAND_SEED_COUNT;
+	if (island_branching_size != c.island_branching_size)
+		changed |= CONFIG_ISLAND_BRANCHING_SIZE;
+	if (height_multiplier != c.height_multiplier)
+		changed |= CONFIG_HEIGHT_MULTIPLIER;
+	if (inland_lake_size != c.inland_lake_size)
+		changed |= CONFIG_INLAND_LAKE_SIZE;
+	if (erosion_iterations != c.erosion_iterations)
+		changed |= CONFIG_EROSION_ITERATIONS;
+	if (aridity_multiplier != c.aridity_multiplier)
+		changed |= CONFIG_ARIDITY_MULTIPLIER;
+	if (moisture_transport != c.moisture_transport || moisture_tolerance != c.moisture_tolerance || moisture_iterations != c.moisture_iterations)
+		changed |= CONFIG_MOISTURE;
+	if (lazy_fields != c.lazy_fields)
+		changed |= CONFIG_LAZY_FIELDS;
+	if (mesh_source != c.mesh_source || icosphere_jitter != c.icosphere_jitter)
+		changed |= CONFIG_MESH_SOURCE;
+	return changed;
+}
 
-	for (auto &f : faces) {
-		auto center = f->get_center();
+world_config_t world_config_t::resized(const double &size) const
+{
+	const double scale = size / face_size;
+	world_config_t c = *this;
+	c.face_size = size;
+	c.island_branching_size = MAX<int>(1, (int)std::lround(island_branching_size / scale));
+	c.inland_lake_size = MAX<int>(1, (int)std::lround(inland_lake_size / (scale * scale)));
+	return c;
+}
 
-		double t = std::sqrt(std::pow(center[0] - yaw, 2) + std::pow(center[1] - pit, 2));
-		if (t < d) {
-			curr = f;
-			d = t;
-		}
+void world_config_t::hash(hasher_t &h, const unsigned int &params) const
+{
+	if (params & CONFIG_FACE_SIZE)
+		h.add(face_size);
+	if (params & CONFIG_ISLAND_SEED_COUNT)
+		h.add(island_seed_count);
+	if (params & CONFIG_ISLAND_BRANCHING_SIZE)
+		h.add(island_branching_size);
+	if (params & CONFIG_HEIGHT_MULTIPLIER)
+		h.add(height_multiplier);
+	if (params & CONFIG_INLAND_LAKE_SIZE)
+		h.add(inland_lake_size);
+	if (params & CONFIG_EROSION_ITERATIONS)
+		h.add(erosion_iterations);
+	if (params & CONFIG_ARIDITY_MULTIPLIER)
+		h.add(aridity_multiplier);
+	if (params & CONFIG_MOISTURE) {
+		h.add(moisture_transport);
+		h.add(moisture_tolerance);
+		h.add(moisture_iterations);
+	}
+	if (params & CONFIG_LAZY_FIELDS)
+		h.add(lazy_fields);
+	if (params & CONFIG_MESH_SOURCE) {
+		h.add(mesh_source);
+		h.add(icosphere_jitter);
 	}
+}
 
-	return curr;
+bool world_t::configure(const world_config_t &next, progress_t *progress)
+{
+	std::vector<bool> dirty = stages.dirty(config.diff(next));
+	config = next;
+	out() << "Reconfiguring:";
+	for (size_t s = 0; s < dirty.size(); s++) {
+		if (dirty[s])
+			out() << " " << stages.stages[s].name;
+	}
+	out() << "\n";
+	this->progress = progress;
+	bool finished = run_stages(dirty);
+	this->progress = NULL;
+	return finished;
+}
+
+bool world_t::reseed(const int &seed, progress_t *progress)
+{
+	// the mesh came from the old seed, so nothing from here on may be keyed by the new one
+	this->seed = seed;
+	config.cache_directory.clear();
+	noise_offset = random_t(seed, "noise").below(32768, 0);
+	aridity_noise.clear();
+
+	std::vector<bool> dirty = stages.all();
+	dirty[0] = false;
+	this->progress = progress;
+	bool finished = run_stages(dirty);
+	this->progress = NULL;
+	return finished;
+}
+
+const world_config_t &world_t::get_config() const
+{
+	return config;
+}
+
+std::vector<std::pair<std::string, double>> world_t::get_stage_times() const
+{
+	std::vector<std::pair<std::string, double>> times;
+	for (size_t s = 0; s < stage_seconds.size(); s++)
+		times.push_back({ stages.stages[s].name, stage_seconds[s] });
+	return times;
+}
+
+const std::vector<task_span_t> &world_t::get_timeline() const
+{
+	return timeline;
+}
+
+std::vector<std::pair<std::string, exchange_stats_t>> world_t::get_exchange_stats() const
+{
+	return cluster.get_stats();
+}
+
+const mesh_t &world_t::get_topology() const
+{
+	return topology;
+}
+
+surface_t *world_t::get_parent(const surface_t *f) const
+{
+	if (coarse == NULL || parents.empty())
+		return NULL;
+	return coarse->faces[parents[f->ID]];
+}
+
+column_stats_t world_t::get_column_stats() const
+{
+	return columns.get_stats();
+}
+
+cache_stats_t world_t::get_cache_stats() const
+{
+	return disk_cache.stats;
+}
+
+world_t::world_t(const int &seed, const world_config_t &config, progress_t *progress)
+	: seed(seed)
+	, config(config)
+	, progress(progress)
+{
+	generate();
+}
+
+world_t::world_t(const world_t &coarse, const world_config_t &config, progress_t *progress)
+	: seed(coarse.seed)
+	, config(config)
+	, progress(progress)
+	, coarse(&coarse)
+{
+	this->config.cache_directory.clear();
+	generate();
+}
+
+void world_t::generate()
+{
+	noise_offset = random_t(seed, "noise").below(32768, 0);
+	add_stages();
+	bool finished = run_stages(stages.all());
+	this->progress = NULL;
+	if (!finished) {
+		out() << "Cancelled.\n";
+		return;
+	}
+
+	out() << "---------------------------------\n";
+	out() << "Face Count: " << faces.size() << "\n";
+	out() << "Landmass Count: " << landmasses.size() << "\n";
+	out() << "---------------------------------\n";
+
+	out() << "Done.\n";
+}
+
+
+world_t::world_t(const std::vector<surface_t *> &faces)
+	: faces(faces)
+{
+	index.build(faces);
+	traversal.resize(faces.size());
+	set_landmasses();
+}
+
+surface_t *world_t::find_closest(const double &yaw, const double &pit)
+{
+	return index.nearest(point3_t(polar_t(yaw, pit), 1)).first;
 }
 
 std::vector<surface_t *> world_t::get_faces() const
@@ -651,10 +1911,20 @@ std::vector<surface_t *> world_t::get_faces() const
 	return faces;
 }
 
+std::vector<landmass_t *> world_t::get_landmasses() const
+{
+	return landmasses;
+}
+
 world_t::~world_t()
 {
-	for (auto &e : faces)
-		delete e;
+	// only faces handed in were made one by one
+	if (surfaces.empty()) {
+		for (auto &e : faces)
+			delete e;
+	}
 	for (auto &e : landmasses)
 		delete e;
+	delete sea_levels;
+	delete lake_field;
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 /* -------- OPTIONS --------- */
+/* defaults for world_config_t */
 
 #define HEIGHT_MULTIPLIER		1.0
 #define ARIDITY_MULTIPLIER		1.0
@@ -8,46 +9,293 @@
 #define ISLAND_SEED_COUNT		8
 #define ISLAND_BRANCHING_SIZE	64
 #define FACE_SIZE				1
+#define EROSION_ITERATIONS		0
+#define MOISTURE_TRANSPORT		0
+#define MOISTURE_TOLERANCE		1e-5
+#define MOISTURE_ITERATIONS		2000
+#define LAZY_FIELDS				0
+#define MESH_SOURCE				MESH_HULL		// MESH_HULL, MESH_PARALLEL_HULL or MESH_ICOSPHERE, see world_config_t
+#define ICOSPHERE_JITTER		0.0				// how far icosphere vertices may move, in edges; keep under 0.25
+#define STAGE_CACHE_DIRECTORY	""				// a directory such as "stage_cache" keeps stages on disk, empty disables it
+#define WORKERS					0				// worker processes for partitioned stages, 0 or 1 keeps them in this process
+#define COLUMN_DIRECTORY		""				// empty keeps snapshots, faces and per-face arrays on the heap
+#define COLUMN_MEMORY_BUDGET	(256 << 20)		// bytes of snapshot tiles kept mapped, and of arrays kept resident after a stage
 
 /* -------------------------- */
 
+#include <atomic>
+#include <memory>
+#include <ostream>
+#include <mutex>
+#include <string>
 #include <vector>
 
 #include "../surface/surface.h"
+#include "../index/index.h"
+#include "../traverse/traverse.h"
+#include "../sealevel/sealevel.h"
+#include "../wind/wind.h"
+#include "../stage/stage.h"
+#include "../cache/cache.h"
+#include "../progress/progress.h"
+#include "../parallel/parallel.h"
+#include "../random/random.h"
+#include "../distribute/distribute.h"
+#include "../column/column.h"
+#include "../mesh/mesh.h"
 
-struct section_t
-{
-	int lon, lat;
-	std::vector<surface_t *> members;
-	const bool operator==(const section_t &s) const;
-};
+struct distance_field_t;
 
 constexpr inline double scale(const double &pit)
 {
 	return 1.0 / std::sin((M_PI * pit) / 180.0);
 }
 
+/*
+ * Generation parameters, read at runtime. Every parameter has a bit so a
+ * change can be traced to the stages that read it. The cache directory,
+ * verbosity, worker count and where stage snapshots live do not change what
+ * is generated and have no bit. resized() gives the same parameters at
+ * another face size, with island branching (counted in steps between faces)
+ * and the inland lake size (counted in faces) scaled to cover the same part
+ * of the sphere.
+ */
+struct world_config_t
+{
+	enum param_t
+	{
+		CONFIG_FACE_SIZE = 1 << 0,
+		CONFIG_ISLAND_SEED_COUNT = 1 << 1,
+		CONFIG_ISLAND_BRANCHING_SIZE = 1 << 2,
+		CONFIG_HEIGHT_MULTIPLIER = 1 << 3,
+		CONFIG_INLAND_LAKE_SIZE = 1 << 4,
+		CONFIG_EROSION_ITERATIONS = 1 << 5,
+		CONFIG_ARIDITY_MULTIPLIER = 1 << 6,
+		CONFIG_MOISTURE = 1 << 7,
+		CONFIG_LAZY_FIELDS = 1 << 8,
+		CONFIG_MESH_SOURCE = 1 << 9
+	};
+
+	/*
+	 * Where the mesh comes from. Both hulls triangulate the same jittered
+	 * points into the same faces, but number them differently, so they make
+	 * different worlds from one seed; the parallel one is built over all
+	 * threads. The icosphere subdivides an icosahedron instead.
+	 */
+	enum mesh_source_t
+	{
+		MESH_HULL,
+		MESH_PARALLEL_HULL,
+		MESH_ICOSPHERE
+	};
+
+	double face_size = FACE_SIZE;
+	int island_seed_count = ISLAND_SEED_COUNT;
+	int island_branching_size = ISLAND_BRANCHING_SIZE;
+	double height_multiplier = HEIGHT_MULTIPLIER;
+	int inland_lake_size = INLAND_LAKE_SIZE;
+	int erosion_iterations = EROSION_ITERATIONS;
+	double aridity_multiplier = ARIDITY_MULTIPLIER;
+	bool moisture_transport = MOISTURE_TRANSPORT;
+	double moisture_tolerance = MOISTURE_TOLERANCE;
+	int moisture_iterations = MOISTURE_ITERATIONS;
+	bool lazy_fields = LAZY_FIELDS;
+	mesh_source_t mesh_source = MESH_SOURCE;
+	double icosphere_jitter = ICOSPHERE_JITTER;
+	std::string cache_directory = STAGE_CACHE_DIRECTORY;
+	bool verbose = true;
+	int workers = WORKERS;
+	std::string column_directory = COLUMN_DIRECTORY;
+	size_t column_budget = COLUMN_MEMORY_BUDGET;
+
+	unsigned int diff(const world_config_t &) const;
+	void hash(hasher_t &, const unsigned int &) const;
+	world_config_t resized(const double &) const;
+};
+
+/*
+ * A hand edit of one face. Types are terrain types (land, ocean or a spring);
+ * rivers and lakes are always derived from them. get_terrain() gives a face's
+ * current terrain type, for edits that only change the height.
+ */
+struct terrain_edit_t
+{
+	surface_t *face;
+	double height;
+	surface_t::surface_type type;
+};
+
+/* how much of a lazy world has been evaluated so far */
+struct evaluation_stats_t
+{
+	size_t faces;
+	size_t aridity;
+	size_t foehn;
+	size_t bands;
+};
+
+/*
+ * Generation runs as a graph of stages, each reseeding the world's generator
+ * from (seed, stage) so it draws the same numbers however it is reached. Every
+ * stage caches the columns it writes; configure() reruns only the stages that
+ * read a changed parameter and their downstream stages, starting from the
+ * cached columns of the clean stages before them. Edits and sea level changes
+ * in the rerun columns are discarded. With a cache directory every stage that
+ * writes something is also kept on disk under a key of the seed and all the
+ * parameters upstream of it, and is loaded from there instead of rerun.
+ * The cached columns live in a column_store_t: with a column directory they
+ * are files mapped a tile at a time under the column budget. Stages and edits
+ * run in a column_scope_t of that store, so the face block, the mesh, the
+ * index and every per-face array they keep or build are mapped files too,
+ * which the system pages out instead of running out of memory; the heap only
+ * holds the face pointers and small state.
+ * Given a progress, generation and configure() report every stage and stop
+ * at the next check once it is cancelled; the world is then half built and
+ * only good for deleting. reseed() reruns everything but the mesh for another
+ * seed, which is how many previews share one mesh; such a world no longer
+ * matches its key and stays out of the disk cache.
+ *
+ * A world can also refine a coarser one of the same seed. It builds its own
+ * finer mesh and links every face to the coarse face nearest its center,
+ * then takes the land, water and deep ocean layout from the coarse world
+ * instead of growing islands. Only faces under a coarse border look the
+ * layout up again at a point warped by noise, which adds detail to coasts
+ * below the coarse spacing. Deep ocean roots and springs move to the faces
+ * nearest their coarse counterparts. The stages that derive heights, water,
+ * rivers and climate from the layout then run as usual. The coarse world
+ * must outlive the refined one. It is not part of any stage key, so a
+ * refined world stays out of the disk cache.
+ */
 struct world_t
 {
 private:
+	enum column_bit_t
+	{
+		COLUMN_TYPE = 1 << 0,
+		COLUMN_HEIGHT = 1 << 1,
+		COLUMN_ARIDITY = 1 << 2,
+		COLUMN_FOEHN = 1 << 3
+	};
+
+	struct stage_cache_t
+	{
+		column_t type;
+		column_t height;
+		column_t aridity;
+		column_t foehn;
+	};
+
+	int seed = 0;
+	world_config_t config;
+	stage_graph_t stages;
+	column_store_t columns;
+	std::vector<stage_cache_t> caches;
+	std::vector<double> stage_seconds;
+	std::vector<task_span_t> timeline;
+	disk_cache_t disk_cache;
+	cluster_t cluster;
+	progress_t *progress = NULL;
+	std::ostream silent{ NULL };
+	std::vector<surface_t *> deep_roots;
+	column_vector_t<double> height_noise;
+	const world_t *coarse = NULL;
+	column_vector_t<uint32_t> parents;
+
+	column_vector_t<surface_t> surfaces;	// the faces this world made, in one block
 	std::vector<surface_t *> faces;
+	mesh_t topology;	// empty for worlds made from a list of faces
 	std::vector<landmass_t *> landmasses;
-	section_t sections[36][18];
+	sphere_index_t index;
+	traversal_t traversal;
+	sea_level_sweep_t *sea_levels = NULL;
+
+	// state kept so edits can be applied locally, loaded worlds derive it on their first edit
+	int noise_offset = -1;
+	column_vector_t<surface_t::surface_type> terrain;
+	column_vector_t<double> aridity_noise;
+	distance_field_t *lake_field = NULL;
+	foehn_t foehn;
+
+	/*
+	 * With lazy_fields the constructor stops after the rivers and landmasses;
+	 * aridity and foehn are computed on first access through the getters,
+	 * which may be called from many threads at once. Every face is claimed by
+	 * the first thread to ask for it and the others wait for its result.
+	 */
+	bool lazy = false;
+	std::unique_ptr<std::atomic<unsigned char>[]> aridity_state;
+	std::unique_ptr<std::atomic<unsigned char>[]> foehn_state;
+	std::atomic<size_t> aridity_count{ 0 };
+	std::atomic<size_t> foehn_count{ 0 };
+	std::mutex moisture_lock;
+	std::atomic<bool> moisture_ready{ false };
+	column_vector_t<double> moisture_dryness;
+
+	std::ostream &out();
+	landmass_t *landmass_color(const size_t &) const;
+	void add_stages();
+	void generate();
+	bool run_stages(const std::vector<bool> &);
+	void run_stage(const size_t &, const size_t &, const uint64_t &, std::mutex &);
+	void restore_column(const stage_cache_t &, const unsigned int &);
+	bool load_stage(const size_t &, blob_t &);
+	void save_stage(const size_t &, blob_t &);
+	void clear_mesh();
+	void save_mesh(blob_t &);
+	bool load_mesh(blob_t &);
+	void build_mesh(const random_t &);
+	void build_hull(const random_t &, column_vector_t<polar_t> &, column_vector_t<uint32_t> &);
+	void build_icosphere(const random_t &, column_vector_t<polar_t> &, column_vector_t<uint32_t> &);
+	void set_neighbors();
+	void link_parents();
+	std::vector<surface_t::surface_type> stage_types(const std::string &) const;
+	void inherit_layout();
+	void inherit_deep_roots();
+	void inherit_springs();
+	void set_noise();
+	void set_islands(const random_t &);
+	void set_deep_ocean(const random_t &);
+	void set_heights();
+	void set_water_types(const random_t &);
+	void erode_terrain();
+	void set_springs(const random_t &);
+	void set_rivers();
+	void set_aridity();
+	distance_field_t build_field(const surface_t::surface_type &);
+	components_t build_components(const surface_t::surface_type &);
+	column_vector_t<double> get_dryness();
+	const column_vector_t<double> &get_moisture_dryness();
+	void evaluate_all();
+	void prepare_edits();
+	std::vector<surface_t *> relabel_landmasses(const std::vector<surface_t *> &);
 public:
-	world_t(const int &);
+	world_t(const int &, const world_config_t & = world_config_t(), progress_t * = NULL);
 	world_t(const std::vector<surface_t *> &);
+	world_t(const world_t &, const world_config_t &, progress_t * = NULL);
+	bool configure(const world_config_t &, progress_t * = NULL);
+	bool reseed(const int &, progress_t * = NULL);
+	const world_config_t &get_config() const;
+	cache_stats_t get_cache_stats() const;
+	std::vector<std::pair<std::string, exchange_stats_t>> get_exchange_stats() const;
+	column_stats_t get_column_stats() const;
+	const mesh_t &get_topology() const;
+	surface_t *get_parent(const surface_t *) const;
+	std::vector<std::pair<std::string, double>> get_stage_times() const;
+	const std::vector<task_span_t> &get_timeline() const;
 	~world_t();
-	const std::vector<section_t> expand(const std::vector<section_t> &input, const std::vector<section_t> &explored);
-	bool iterate_rivers();
 	surface_t *find_closest(const double &, const double &);
 	std::pair<surface_t *, double> find_nearest(surface_t *, const surface_t::surface_type &);
-	std::vector<surface_t *> get_lake_edges(surface_t *, std::vector<const surface_t *> &);
-	std::vector<surface_t *> get_water_extent(surface_t *);
-	void make_landmasses(surface_t *);
-	void iterate_land(surface_t *, int);
-	void propagate_wind_east(surface_t *, double, const double &, std::vector<const surface_t *> &);
-	void propagate_wind_west(surface_t *, double, const double &, std::vector<const surface_t *> &);
+	void set_landmasses();
+	void iterate_land(const std::vector<surface_t *> &, const int &);
 	void set_foehn();
-	void stagnate_lake(const double &, surface_t *);
+	std::vector<sea_level_t> sweep_sea_levels(const std::vector<double> &);
+	void set_sea_level(const double &);
+	size_t edit(const std::vector<terrain_edit_t> &);
+	surface_t::surface_type get_terrain(surface_t *);
+	double get_aridity(surface_t *);
+	double get_foehn(surface_t *);
+	biome_t get_biome(surface_t *);
+	evaluation_stats_t get_evaluation_stats() const;
 	std::vector<surface_t *> get_faces() const;
+	std::vector<landmass_t *> get_landmasses() const;
 };
\ No newline at end of file